@@ -9,22 +9,52 @@
  * for memory allocation. The allocator is optimized for
  * blocks of theses sizes.
  *
- * There can be a maximum of 4 pools created and a minimum
- * of 1.
+ * There can be a maximum of 64 pools created and a minimum
+ * of 1. Block sizes are rounded up to a multiple of 8, which keeps
+ * every block aligned, and pool_memalign picks a pool whose blocks are
+ * aligned enough for the request. pool_init_geometric creates
+ * jemalloc style pools whose block sizes grow by a fixed number of
+ * steps per doubling.
  * Read the data structures section for more on how blocks
  * and pools were implemented.
  *
- * The cap can be changed by altering MAX_NUM_POOLS
- * Due to the cap of 4 pools the time complexities of pool_init,
- * pool_malloc, and pool_free are O(1)
+ * Every thread keeps a small cache of free blocks per pool in front
+ * of the shared pools. pool_malloc and pool_free normally only touch
+ * that cache; the shared pools are refilled from and flushed to in
+ * batches. The free lists of the shared pools are lock-free.
+ *
+ * pool_init_weighted gives each pool a share of the heap in proportion
+ * to its weight instead of an equal one. Pools start and end on pages
+ * of the heap, and a map from pages to pools finds the pool of a block.
+ *
+ * pool_init_spans does away with fixed shares: the heap is cut into
+ * spans that pools take as they run out of blocks and give back once
+ * all of a span's blocks are free, so any pool can reuse them.
+ *
+ * Pools on g_pool_heap have a fixed size. pool_init_growable and
+ * pool_create_growable instead reserve a large range of address space
+ * split between the pools the same way, and each pool maps more of its
+ * part whenever it runs out of blocks.
+ *
+ * All of the state above lives in an allocator context. pool_init,
+ * pool_malloc and pool_free work on a context backed by g_pool_heap;
+ * pool_create makes further independent contexts with heaps of their
+ * own, which share no metadata with each other or with g_pool_heap.
+ *
+ * The cap can be changed by altering POOL_MAX_NUM_POOLS, up to 255 since
+ * the size class tables name pools with a byte.
+ * pool_malloc and pool_free find their pool with table lookups, so
+ * the time complexities of pool_malloc and pool_free are O(1) and
+ * don't grow with the number of pools. pool_init is O(1) due to the
+ * cap on pools.
  *
  *
  * Potential existance of bytes that can't be utilized:
  *
  * Depending on the size values in the block_sizes array (during pool
  * initiliazation) there may be bytes that will remain unused or wasted.
- * The only case where this won't happen is if HEAP_SIZE/block_size_count
- * is perfectly divisible by all the sizes in the block_sizes array.
+ * The only case where this won't happen is if the size of every pool
+ * is perfectly divisible by its block size.
  *
  *
  * @author Akash Arun <akasha@andrew.cmu.edu>
@@ -32,15 +62,40 @@
 
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#ifdef POOL_TRACE
+#include <fcntl.h>
+#include <time.h>
+#endif
+#define POOL_ALLOC_INTERNAL
+#include "pool_alloc_inline.h"
+#include "pool_trace.h"
 
 
 #define HEAP_SIZE 65536
-#define MAX_NUM_POOLS 4
+#define MAX_NUM_POOLS POOL_MAX_NUM_POOLS
+#define TCACHE_MAX_BATCH 16
+#define GROW_MIN_SIZE 65536
+#define MAP_PAGES 4096
+#define MIN_PAGE_SHIFT 8
+#define NO_POOL 0xff
+#define MAX_ALIGN 64
+#define SPAN_MIN_SHIFT 12
+#define NO_SPAN UINT32_MAX
+#define SMALL_SIZE_MAX POOL_SMALL_SIZE_MAX
+#define NUM_SMALL_CLASSES (SMALL_SIZE_MAX/8 + 1)
+#define NUM_LARGE_CLASSES 64
+#define TRACE_RING_SIZE 4096
+#define TRACE_FLUSH_NS 1000000
 
 
-static uint8_t g_pool_heap[HEAP_SIZE];
+static _Alignas(MAX_ALIGN) uint8_t g_pool_heap[HEAP_SIZE];
 
 /* Data Structures */
 
@@ -53,9 +108,9 @@ static uint8_t g_pool_heap[HEAP_SIZE];
  *     in the pool or to NULL
  */
 
-typedef struct block {
+typedef struct pool_block {
     union {
-        struct block *next;
+        struct pool_block *next;
         char payload[0];
     };
 } block_t;
@@ -63,34 +118,192 @@ typedef struct block {
 /* A pool is a data structure that contains blocks and
  * consists of:
  * ~ A pointer to the first block of the pool
- * ~ A pointer to either:
+ * ~ A tagged head (see below) naming either:
  *   - the latest freed block of the pool
  *   - the first free block of the pool
  *   - a location outside of the pool (when the pool is full)
  * ~ A pointer to the last block of the pool
+ * ~ The number of bytes of the heap reserved for the pool and the
+ *   number of those that are mapped, from the start of the pool. Only
+ *   pools of growable contexts map less than they reserve, and they move
+ *   pool_end forward as they map more
+ * ~ The reciprocal of the block size (see recip below)
+ * ~ The first span of the pool that has free blocks, when the pool is
+ *   made of spans (see below) instead of one range of the heap
+ * ~ Counters for pool_get_stats, updated once per batch moved between
+ *   the pool and a thread cache: the blocks currently taken from the
+ *   pool, the most that ever were, and the blocks taken that were never
+ *   allocated before
+ *
+ * The head packs the offset of that location into g_pool_heap into its
+ * low 32 bits and a tag into its high 32 bits. The tag is bumped on every
+ * update so that a compare-and-swap of the head fails if the free list
+ * changed in between, even when the same block is back on top (ABA).
+ * This lets threads push and pop without a lock using a single 64 bit
+ * compare-and-swap.
 */
 
 typedef struct pool {
 
     block_t *pool_start;
-    block_t *pool_curr;
+    uint64_t pool_head;
     block_t *pool_end;
+    size_t pool_reserved;
+    size_t pool_mapped;
 
     size_t pool_block_size;
+    uint64_t pool_recip;
+    size_t pool_batch;
+    uint32_t pool_partial;
+
+    uint64_t pool_taken;
+    uint64_t pool_drawn_peak;
+    uint64_t pool_carved;
 } pool_t;
 
+#define HEAD_OFFSET(head) ((uint32_t) (head))
+#define HEAD_UPDATE(head, offset) \
+    ((((head) >> 32) + 1) << 32 | (uint32_t) (offset))
+
+/* A span is a fixed size page of the heap that is handed to one pool
+ * at a time, used instead of fixed pool ranges by contexts initialized
+ * with pool_ctx_init_spans, and consists of:
+ * ~ The blocks of the span that were freed, linked through their next
+ *   pointers
+ * ~ The offset into the heap of the next block that was never handed out
+ * ~ The number of blocks handed out and not yet freed
+ * ~ The previous and next span in the list of spans with free blocks of
+ *   its pool, or the next span in the pool of unused spans
+ * ~ The pool it belongs to, NO_POOL while it is unused
+ * ~ Whether it is in the list of spans with free blocks of its pool
+ * ~ Whether it was never used by another pool, so that its blocks that
+ *   were never handed out are still zero
+ *
+ * A span goes back to the pool of unused spans as soon as none of its
+ * blocks are handed out, and any pool can take it from there.
+*/
+
+typedef struct span {
+    block_t *free;
+    uint32_t carve;
+    uint32_t live;
+    uint32_t prev;
+    uint32_t next;
+    uint8_t pool;
+    bool partial;
+    bool fresh;
+} span_t;
+
+/* A thread cache is a per-thread data structure that holds, for every
+ * pool, a stack of free blocks linked through their next pointers:
+ * ~ The epoch of pool_init the cached blocks belong to
+ * ~ Whether the thread exit hook has been registered for this thread
+ * ~ One bin per pool with the top of the stack, its length and the
+ *   number of blocks at the bottom of the stack that were never
+ *   allocated, which are zero apart from their next pointer
+ *
+ * A bin is refilled with pool_batch blocks when it is empty and gives
+ * pool_batch blocks back when it holds more than twice that many.
+ *
+ * Every bin also counts the blocks the thread allocated and freed, and
+ * its requests that failed or spilled into larger pools. Thread caches
+ * are linked into tcache_list so that pool_get_stats can sum them up.
+ *
+ * The layout is in pool_alloc_inline.h, whose inline pool_malloc pops
+ * blocks off the bins without calling into this file.
+*/
+
+typedef pool_tcache_bin_t tcache_bin_t;
+typedef pool_tcache_t tcache_t;
+
+
+/* An allocator context is a data structure that owns one heap and
+ * the pools carved from it, and consists of:
+ * ~ A pointer to the heap and its size in bytes
+ * ~ Whether the heap is a reserved range of address space that pools
+ *   map on demand, and the lock taken to map more of it or to move
+ *   spans between pools
+ * ~ The list of pools, sorted by block size, and the number of pools
+ *   in use
+ * ~ Whether the free lists of the pools were threaded through all of
+ *   their blocks at initialization, so that no block has a NULL next
+ *   pointer and walks skip find_next
+ * ~ A map from every page of the heap to the pool it belongs to, or
+ *   NO_POOL. Pools start and end on a page, which is the smallest power
+ *   of two of at least 2^MIN_PAGE_SHIFT bytes (a system page for a
+ *   growable heap) that splits the heap into at most MAP_PAGES pages
+ * ~ Whether the pools are made of spans, in which case a page is a span
+ *   of at least 2^SPAN_MIN_SHIFT bytes, and for those:
+ *   - the spans of the heap and their number
+ *   - the top of the stack of unused spans that were used before
+ *   - the first span that was never used
+ * ~ Two tables mapping a requested size to the first pool that may
+ *   fit it:
+ *   - small_class, indexed by (n+7)>>3 for n up to SMALL_SIZE_MAX
+ *   - large_class, indexed by floor(log2(n-1)) for larger n
+ * ~ The epoch of the latest initialization of the pools, bumped by
+ *   every successful initialization so that blocks cached by threads
+ *   for an earlier layout are dropped instead of handed out
+*/
+
+struct pool_ctx {
+    uint8_t *heap;
+    size_t heap_size;
+    bool growable;
+    pthread_mutex_t lock;
+
+    pool_t pools_list[MAX_NUM_POOLS];
+    size_t num_pools;
+    bool eager;
+
+    uint8_t page_pool[MAP_PAGES];
+    size_t page_shift;
+
+    bool use_spans;
+    span_t *spans;
+    uint32_t num_spans;
+    uint32_t free_spans;
+    uint32_t span_frontier;
+
+    uint8_t small_class[NUM_SMALL_CLASSES];
+    uint8_t large_class[NUM_LARGE_CLASSES];
+
+    uint64_t epoch;
+};
+
 
 /* Global Variables:
- * They are initialized by the pool_init function
+ * g_pool_ctx is initialized by the pool_init function
+ * g_spans holds the spans of g_pool_ctx after pool_init_spans
+ * pool_fast holds copies of the epoch and small_class table of
+ * g_pool_ctx for the inline pool_malloc
+ * pool_tcache is the thread cache of the calling thread
+ * tcache_list links the thread caches of live threads, and retired
+ * holds the counters of threads that exited, both guarded by stats_lock
 */
 
 /*
-Design decision: A max of 4 pools
-i.e a max of 4 different block sizes
+Design decision: A max of 64 pools
+i.e a max of 64 different block sizes
 */
 
-static pool_t pools_list[MAX_NUM_POOLS];
-static size_t num_pools = 0;
+static span_t g_spans[MAP_PAGES];
+
+static pool_ctx_t g_pool_ctx = {
+    .heap = g_pool_heap,
+    .heap_size = HEAP_SIZE,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .spans = g_spans
+};
+
+pool_fast_t pool_fast;
+_Thread_local tcache_t pool_tcache;
+static pthread_key_t tcache_key;
+static pthread_once_t tcache_key_once = PTHREAD_ONCE_INIT;
+
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static tcache_t *tcache_list;
+static tcache_t retired;
 
 
 /* Helper Functions: */
@@ -106,207 +319,3049 @@ static size_t num_pools = 0;
 
 block_t *find_next(block_t *block, size_t size)
 {
-    if (block->next == NULL) {
+    // another thread may be taking this block off the list concurrently,
+    // the tag on the head makes sure a value read that way is discarded
+    block_t *next = __atomic_load_n(&block->next, __ATOMIC_RELAXED);
+
+    if (next == NULL) {
         // If the block has never been allocated before
         // ,i.e part of the unallocated chunk
         return (block_t *)((uint8_t *)block+size);
     }
     else {
         // If the block was allocated and then freed
-        return block->next;
+        return next;
+    }
+}
+
+/* @brief links blocks of a pool in address order and touches every
+ * page under them, so that taking them off the free list later never
+ * faults a page in or looks for NULL next pointers
+ *
+ * param[in] first: the first block to link
+ * param[in] last: the last block of the pool
+ * param[in] size: the size of blocks in the pool
+ *
+ * The last block links to the address right after it, which is where
+ * find_next would go from it, so walks still stop at the end of the pool.
+*/
+
+static void thread_blocks(block_t *first, block_t *last, size_t size)
+{
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    uint8_t *end = (uint8_t *) last + size;
+
+    // blocks larger than a page have pages their links don't touch. The
+    // blocks are still zero, so writing a zero keeps them that way
+    for (uint8_t *page = (uint8_t *) first; page < end; page += page_size) {
+        *(volatile uint8_t *) page = 0;
+    }
+    for (uint8_t *block = (uint8_t *) first; block < end; block += size) {
+        ((block_t *) block)->next = (block_t *) (block + size);
     }
 }
 
-/* @brief finds and returns a free block that is greater
- * than or equal to size; else returns NULL
+/* @brief maps more of the range reserved for a full pool, doubling
+ * the mapped part of the pool each time
  *
+ * param[in] ctx: the allocator context
  * param[in] i: the index of the pool
- * param[in] size: size of the requested block
+ * param[in] seen_end: the last block of the pool when it was found full
  *
- * returns the address of a block or NULL
+ * returns true if the pool has blocks after seen_end now, false if it
+ * can't grow any further
 */
 
-block_t *find_fit(size_t i, size_t size)
+static bool pool_grow(pool_ctx_t *ctx, size_t i, block_t *seen_end)
 {
-    block_t *block = pools_list[i].pool_curr;
+    pool_t *pool = &ctx->pools_list[i];
+    bool grown = false;
 
-    // returns NULL if pool is full, i.e if the block's address is
-    // greater than the pool's last block, or if the requested size
-    // is greater than the size of blocks in this pool
-    if (block >  pools_list[i].pool_end ||
-        size > pools_list[i].pool_block_size) {
-        return NULL;
+    if (pool->pool_mapped == pool->pool_reserved) {
+        return false;
+    }
+
+    pthread_mutex_lock(&ctx->lock);
+    if (__atomic_load_n(&pool->pool_end, __ATOMIC_RELAXED) != seen_end) {
+        // another thread grew the pool while this one waited
+        grown = true;
+    }
+    else if (pool->pool_mapped < pool->pool_reserved) {
+        size_t extra = pool->pool_mapped;
+        if (extra > pool->pool_reserved - pool->pool_mapped) {
+            extra = pool->pool_reserved - pool->pool_mapped;
+        }
+        uint8_t *start = (uint8_t *) pool->pool_start;
+        if (mprotect(start + pool->pool_mapped, extra,
+                     PROT_READ | PROT_WRITE) == 0) {
+            pool->pool_mapped += extra;
+            size_t block_count = pool->pool_mapped/pool->pool_block_size;
+            block_t *end = (block_t *)
+                (start + (block_count-1)*pool->pool_block_size);
+            if (ctx->eager) {
+                // walks can't reach the new blocks before pool_end moves
+                block_t *first = (block_t *)
+                    ((uint8_t *) seen_end + pool->pool_block_size);
+                thread_blocks(first, end, pool->pool_block_size);
+                __atomic_add_fetch(&pool->pool_carved,
+                                   ((uint8_t *) end - (uint8_t *) first) /
+                                   pool->pool_block_size + 1,
+                                   __ATOMIC_RELAXED);
+            }
+            __atomic_store_n(&pool->pool_end, end, __ATOMIC_RELEASE);
+            grown = true;
+        }
+    }
+    pthread_mutex_unlock(&ctx->lock);
+    return grown;
+}
+
+/* @brief adds a span to the front of the list of spans with free
+ * blocks of its pool, or takes it off that list
+ *
+ * param[in] ctx: the allocator context, with its lock held
+ * param[in] s: the index of the span
+*/
+
+static void span_link(pool_ctx_t *ctx, uint32_t s)
+{
+    span_t *span = &ctx->spans[s];
+    pool_t *pool = &ctx->pools_list[span->pool];
+
+    span->prev = NO_SPAN;
+    span->next = pool->pool_partial;
+    if (span->next != NO_SPAN) {
+        ctx->spans[span->next].prev = s;
+    }
+    pool->pool_partial = s;
+    span->partial = true;
+}
+
+static void span_unlink(pool_ctx_t *ctx, uint32_t s)
+{
+    span_t *span = &ctx->spans[s];
+
+    if (span->prev != NO_SPAN) {
+        ctx->spans[span->prev].next = span->next;
+    }
+    else {
+        ctx->pools_list[span->pool].pool_partial = span->next;
+    }
+    if (span->next != NO_SPAN) {
+        ctx->spans[span->next].prev = span->prev;
     }
-    pools_list[i].pool_curr =
-        find_next(block, pools_list[i].pool_block_size);
-    return block;
+    span->partial = false;
 }
 
-/* @brief adds a certain block back to the pools current
- * pointer so that it is available for future allocation
+/* @brief hands an unused span to a pool, mapping it first if it was
+ * never used and the heap is growable
  *
+ * param[in] ctx: the allocator context, with its lock held
  * param[in] i: the index of the pool
- * param[in] block: address of the block that is being
- * added to the pool
+ *
+ * returns the index of the span, or NO_SPAN if every span is in use
 */
 
-void add_to_pool(size_t i, block_t *block)
+static uint32_t span_acquire(pool_ctx_t *ctx, size_t i)
 {
-    block->next = pools_list[i].pool_curr;
-    pools_list[i].pool_curr = block;
+    uint32_t s = ctx->free_spans;
+    size_t span_size = (size_t) 1 << ctx->page_shift;
+    bool fresh = false;
+
+    if (s != NO_SPAN) {
+        ctx->free_spans = ctx->spans[s].next;
+    }
+    else if (ctx->span_frontier < ctx->num_spans) {
+        s = ctx->span_frontier;
+        if (ctx->growable &&
+            mprotect(&ctx->heap[(size_t) s << ctx->page_shift], span_size,
+                     PROT_READ | PROT_WRITE) != 0) {
+            return NO_SPAN;
+        }
+        __atomic_store_n(&ctx->span_frontier, s + 1, __ATOMIC_RELAXED);
+        fresh = true;
+    }
+    else {
+        return NO_SPAN;
+    }
 
+    span_t *span = &ctx->spans[s];
+    span->free = NULL;
+    span->carve = s << ctx->page_shift;
+    span->live = 0;
+    span->pool = i;
+    span->fresh = fresh;
+    span_link(ctx, s);
+    // read without the lock by find_pool, but only for blocks that are
+    // handed out, which keep the span from moving to another pool
+    __atomic_store_n(&ctx->page_pool[s], i, __ATOMIC_RELAXED);
+    return s;
 }
 
+/* @brief takes up to count free blocks off a pool made of spans and
+ * returns them as a NULL terminated chain, taking unused spans for the
+ * pool when its own spans are full
+ *
+ * param[in] ctx: the allocator context
+ * param[in] i: the index of the pool
+ * param[in] count: the maximum number of blocks to take
+ * param[out] chain: the first block of the chain, NULL if the pool is
+ * full and no span is unused
+ * param[out] fresh: the number of blocks at the end of the chain that
+ * are zero apart from their next pointer
+ *
+ * returns the number of blocks in the chain
+*/
 
-/* @brief Checks the parameters provided for initialization of the pools
+static size_t span_take(pool_ctx_t *ctx, size_t i, size_t count,
+                        block_t **chain, size_t *fresh)
+{
+    pool_t *pool = &ctx->pools_list[i];
+    size_t size = pool->pool_block_size;
+    block_t **link = chain;
+    block_t *fresh_head = NULL, **fresh_link = &fresh_head;
+    size_t taken, fresh_count = 0;
+
+    pthread_mutex_lock(&ctx->lock);
+    for (taken = 0; taken < count; taken++) {
+        uint32_t s = pool->pool_partial;
+        if (s == NO_SPAN && (s = span_acquire(ctx, i)) == NO_SPAN) {
+            break;
+        }
+
+        span_t *span = &ctx->spans[s];
+        block_t *block = span->free;
+        if (block != NULL) {
+            span->free = block->next;
+            *link = block;
+            link = &block->next;
+        }
+        else {
+            block = (block_t *) &ctx->heap[span->carve];
+            span->carve += size;
+            // zeroed blocks go to the end of the chain
+            if (span->fresh) {
+                *fresh_link = block;
+                fresh_link = &block->next;
+                fresh_count++;
+            }
+            else {
+                *link = block;
+                link = &block->next;
+            }
+        }
+        span->live++;
+
+        // full once nothing was freed and the next block would cross
+        // into the following span
+        if (span->free == NULL &&
+            span->carve + size > ((size_t) s + 1) << ctx->page_shift) {
+            span_unlink(ctx, s);
+        }
+    }
+    pthread_mutex_unlock(&ctx->lock);
+
+    *link = fresh_head;
+    *fresh_link = NULL;
+    *fresh = fresh_count;
+    return taken;
+}
+
+/* @brief gives a chain of blocks back to the spans they came from,
+ * and spans with no blocks handed out back to the unused spans
  *
- * param[in] block_sizes: A list containing the payload sizes
- * of the blocks in each respective pool
+ * param[in] ctx: the allocator context
+ * param[in] head: the first block of the chain
+ * param[in] tail: the last block of the chain
+*/
+
+static void span_give(pool_ctx_t *ctx, block_t *head, block_t *tail)
+{
+    block_t *block, *next;
+
+    pthread_mutex_lock(&ctx->lock);
+    for (block = head;; block = next) {
+        uint32_t s = ((uint8_t *) block - ctx->heap) >> ctx->page_shift;
+        span_t *span = &ctx->spans[s];
+
+        next = block->next;
+        block->next = span->free;
+        span->free = block;
+        if (--span->live == 0) {
+            if (span->partial) {
+                span_unlink(ctx, s);
+            }
+            __atomic_store_n(&ctx->page_pool[s], NO_POOL, __ATOMIC_RELAXED);
+            span->pool = NO_POOL;
+            span->next = ctx->free_spans;
+            ctx->free_spans = s;
+        }
+        else if (!span->partial) {
+            span_link(ctx, s);
+        }
+        if (block == tail) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+/* @brief takes up to count free blocks off a pool that was threaded
+ * eagerly, like find_fit does
  *
- * param[in] block_sizes_count: Number of differently sized blocks possible
- * returns true if parameters are appropriate, else returns false
+ * Every free block links to the next, so the walk only follows next
+ * pointers and the chain it took is already linked, apart from its
+ * last block. None of the blocks are known to be zero.
  *
- * Pool initialization fails if:
- * ~ number of block sizes is < 1
- * ~ number of block sizes is > 4
- * ~ the list containing block sizes is NULL
- * ~ block sizes small enough that each pool can atleast store one block
- */
+ * param[in] ctx: the allocator context
+ * param[in] i: the index of the pool
+ * param[in] count: the maximum number of blocks to take
+ * param[out] chain: the first block of the chain, NULL if the
+ * pool is full
+ * param[out] fresh: 0
+ *
+ * returns the number of blocks in the chain
+*/
 
-bool param_verif(const size_t *block_sizes,size_t block_size_count)
+static size_t eager_take(pool_ctx_t *ctx, size_t i, size_t count,
+                         block_t **chain, size_t *fresh)
 {
-    if (block_size_count > MAX_NUM_POOLS || block_size_count == 0
-        || block_sizes == NULL) {
-        return false;
+    pool_t *pool = &ctx->pools_list[i];
+    block_t *pool_end = __atomic_load_n(&pool->pool_end, __ATOMIC_ACQUIRE);
+    size_t first = (uint8_t *) pool->pool_start - ctx->heap;
+    size_t end = (uint8_t *) pool_end - ctx->heap;
+    size_t taken, offset;
+    uint64_t head = __atomic_load_n(&pool->pool_head, __ATOMIC_ACQUIRE);
+    block_t *last = NULL;
+
+    for (;;) {
+        offset = HEAD_OFFSET(head);
+        // stops at the end of the pool, and at garbage read from a block
+        // taken concurrently that points outside of the mapped part of
+        // this pool, like find_fit does
+        for (taken = 0; taken < count && offset - first <= end - first;
+             taken++) {
+            last = (block_t *) &ctx->heap[offset];
+            offset = (uint8_t *) __atomic_load_n(&last->next,
+                                                 __ATOMIC_RELAXED)
+                - ctx->heap;
+        }
+        if (taken == 0) {
+            if (!pool_grow(ctx, i, pool_end)) {
+                *chain = NULL;
+                *fresh = 0;
+                return 0;
+            }
+            pool_end = __atomic_load_n(&pool->pool_end, __ATOMIC_ACQUIRE);
+            end = (uint8_t *) pool_end - ctx->heap;
+            head = __atomic_load_n(&pool->pool_head, __ATOMIC_ACQUIRE);
+            continue;
+        }
+        if (__atomic_compare_exchange_n(&pool->pool_head, &head,
+                                        HEAD_UPDATE(head, offset), true,
+                                        __ATOMIC_ACQUIRE,
+                                        __ATOMIC_ACQUIRE)) {
+            break;
+        }
     }
 
-    size_t max_pool_size  = HEAP_SIZE/block_size_count;
+    *chain = (block_t *) &ctx->heap[HEAD_OFFSET(head)];
+    *fresh = 0;
+    __atomic_store_n(&last->next, NULL, __ATOMIC_RELAXED);
+    return taken;
+}
 
-    for (size_t i = 0; i < block_size_count; i++) {
-        // checks if atleast 1 block can fit in the pool
-        if (max_pool_size/(block_sizes[i]) < 1) {
-            return false;
+/* @brief takes up to count free blocks off a pool without a lock
+ * and returns them as a NULL terminated chain, growing the pool if
+ * it is full and belongs to a growable context. Pools made of spans
+ * take them from their spans instead, and pools threaded eagerly
+ * through eager_take
+ *
+ * param[in] ctx: the allocator context
+ * param[in] i: the index of the pool
+ * param[in] count: the maximum number of blocks to take
+ * param[out] chain: the first block of the chain, NULL if the
+ * pool is full
+ * param[out] fresh: the number of blocks at the end of the chain that
+ * were never allocated, and so are zero apart from their next pointer
+ *
+ * returns the number of blocks in the chain
+*/
+
+size_t find_fit(pool_ctx_t *ctx, size_t i, size_t count, block_t **chain,
+                size_t *fresh)
+{
+    pool_t *pool = &ctx->pools_list[i];
+    block_t *pool_end = __atomic_load_n(&pool->pool_end, __ATOMIC_ACQUIRE);
+    size_t first = (uint8_t *) pool->pool_start - ctx->heap;
+    size_t end = (uint8_t *) pool_end - ctx->heap;
+    size_t taken, offset, start;
+    uint64_t head = __atomic_load_n(&pool->pool_head, __ATOMIC_ACQUIRE);
+
+    if (ctx->use_spans) {
+        return span_take(ctx, i, count, chain, fresh);
+    }
+    if (ctx->eager) {
+        return eager_take(ctx, i, count, chain, fresh);
+    }
+
+    for (;;) {
+        start = offset = HEAD_OFFSET(head);
+        // stops early if the pool is full, i.e if the block's offset is
+        // greater than that of the pool's last block. An offset read from
+        // a block that was taken concurrently may be garbage, so the walk
+        // also stops at any offset outside of the mapped part of this
+        // pool, since the rest of a growable heap may not be mapped. The
+        // CAS then discards what it read
+        for (taken = 0; taken < count && offset - first <= end - first;
+             taken++) {
+            block_t *block = (block_t *) &ctx->heap[offset];
+            offset = (uint8_t *) find_next(block, pool->pool_block_size)
+                - ctx->heap;
+        }
+        if (taken == 0) {
+            if (!pool_grow(ctx, i, pool_end)) {
+                *chain = NULL;
+                *fresh = 0;
+                return 0;
+            }
+            pool_end = __atomic_load_n(&pool->pool_end, __ATOMIC_ACQUIRE);
+            end = (uint8_t *) pool_end - ctx->heap;
+            head = __atomic_load_n(&pool->pool_head, __ATOMIC_ACQUIRE);
+            continue;
+        }
+        if (__atomic_compare_exchange_n(&pool->pool_head, &head,
+                                        HEAD_UPDATE(head, offset), true,
+                                        __ATOMIC_ACQUIRE,
+                                        __ATOMIC_ACQUIRE)) {
+            break;
         }
     }
 
-    return true;
+    // the blocks are ours now, link them explicitly since blocks from
+    // the unallocated chunk still have a NULL next pointer. The chunk is
+    // carved in order, so once one block comes from it the rest do too
+    block_t *block = (block_t *) &ctx->heap[start];
+    *chain = block;
+    *fresh = 0;
+    for (size_t k = 0; k < taken; k++) {
+        if (__atomic_load_n(&block->next, __ATOMIC_RELAXED) == NULL &&
+            *fresh == 0) {
+            *fresh = taken - k;
+        }
+        block_t *next = find_next(block, pool->pool_block_size);
+        __atomic_store_n(&block->next, k + 1 < taken ? next : NULL,
+                         __ATOMIC_RELAXED);
+        block = next;
+    }
+    return taken;
 }
 
-/* Main Functions */
+/* @brief adds a chain of blocks back to the pools head
+ * so that they are available for future allocation, or back to
+ * their spans for pools made of spans
+ *
+ * param[in] ctx: the allocator context
+ * param[in] i: the index of the pool
+ * param[in] head: address of the first block that is being
+ * added to the pool
+ * param[in] tail: address of the last block that is being
+ * added to the pool, equal to head for a single block
+*/
+
+void add_to_pool(pool_ctx_t *ctx, size_t i, block_t *head, block_t *tail)
+{
+    pool_t *pool = &ctx->pools_list[i];
+    uint64_t curr = __atomic_load_n(&pool->pool_head, __ATOMIC_RELAXED);
+
+    if (ctx->use_spans) {
+        span_give(ctx, head, tail);
+        return;
+    }
+
+    do {
+        __atomic_store_n(&tail->next,
+                         (block_t *) &ctx->heap[HEAD_OFFSET(curr)],
+                         __ATOMIC_RELAXED);
+    } while (!__atomic_compare_exchange_n(&pool->pool_head, &curr,
+                                          HEAD_UPDATE(curr,
+                                              (uint8_t *) head - ctx->heap),
+                                          true, __ATOMIC_RELEASE,
+                                          __ATOMIC_RELAXED));
+}
 
 
-/* @brief Initializes the pools based on input parameters
+/* @brief computes the reciprocal used to divide by d with a
+ * multiplication instead of a hardware divide
  *
- * param[in] block_sizes: A list containing the payload sizes
- * of the blocks in each respective pool
- * param[in] block_sizes_count: Number of differently sized blocks possible
+ * For any 32 bit x, recip_div and recip_divisible below are exact
+ * (Lemire et al., "Faster Remainder by Direct Computation"). A divisor
+ * of 1 wraps the reciprocal to 0, which recip_divisible still handles
+ * but recip_div does not.
  *
- * returns true if initialization is succesful
- * else returns false
+ * param[in] d: the divisor, between 1 and 2^32 - 1
  *
- * Precondition: len(block_sizes) == block_size_count
+ * returns the reciprocal of d
+*/
+
+static uint64_t recip(uint32_t d)
+{
+    return UINT64_MAX / d + 1;
+}
+
+/* @brief divides x by the divisor whose reciprocal is r
  *
- * Potential existance of bytes that can't be utilized:
+ * returns x / d
+*/
+
+static inline uint32_t recip_div(uint32_t x, uint64_t r)
+{
+    return (uint32_t) (((__uint128_t) r * x) >> 64);
+}
+
+/* @brief checks whether x is a multiple of the divisor whose
+ * reciprocal is r
  *
- * Depending on the size values in the block_sizes array there may be
- * bytes that will remain unused or wasted. The only case where
- * this won't happen is if HEAP_SIZE/block_size_count is perfectly
- * divisible by all the sizes in the block_sizes array.
+ * returns true if x % d == 0
+*/
+
+static inline bool recip_divisible(uint32_t x, uint64_t r)
+{
+    return x * r <= r - 1;
+}
+
+/* @brief finds the pool with the smallest blocks that fit a size
  *
- * Time Complexity: O(1)
+ * One load from the size class tables gives the first pool whose blocks
+ * may be big enough for n. Block sizes are multiples of 8, so for small
+ * sizes that pool always fits. For large ones it fits unless several
+ * block sizes share the table entry; the loop only steps past those.
  *
- * */
+ * param[in] ctx: the allocator context
+ * param[in] n: the requested size, at least 1
+ *
+ * returns the index of the pool, or num_pools if n is greater than the
+ * size of blocks in the largest pool
+*/
 
-bool pool_init(const size_t *block_sizes, size_t block_size_count)
+static size_t size_class(pool_ctx_t *ctx, size_t n)
 {
+    if (n <= SMALL_SIZE_MAX) {
+        return ctx->small_class[(n+7) >> 3];
+    }
 
-    size_t index, end_index, block_count, space_wastage, max_pool_size;
-
-    if (param_verif(block_sizes, block_size_count) == false) {
-        return false;
+    size_t i = ctx->large_class[63 - __builtin_clzll(n-1)];
+    while (i < ctx->num_pools && ctx->pools_list[i].pool_block_size < n) {
+        i++;
     }
+    return i;
+}
 
-    num_pools = block_size_count;
+/* @brief finds the pool a block belongs to
+ *
+ * The pool is read from the page map, and the block is checked to be
+ * the start of a block in that pool by a multiplication with the
+ * precomputed reciprocal of the block size. For pools made of spans
+ * the page is the span and blocks are counted from its start.
+ *
+ * param[in] ctx: the allocator context
+ * param[in] block: the address of the block
+ *
+ * returns the index of the pool, or num_pools if the address is NULL,
+ * outside of the heap or not the start of a block
+*/
 
-    index = 0;
-    max_pool_size = HEAP_SIZE/block_size_count;
+static size_t find_pool(pool_ctx_t *ctx, block_t *block)
+{
+    size_t offset = (uintptr_t) block - (uintptr_t) ctx->heap;
 
-    for (size_t i = 0; i < num_pools; i++) {
-        pools_list[i].pool_block_size = block_sizes[i];
+    // Cases for if block is NULL or outside of the heap, or in the
+    // bytes after its last whole page, which no pool or span covers
+    if ((offset >> ctx->page_shift) >= (ctx->heap_size >> ctx->page_shift)) {
+        return ctx->num_pools;
+    }
 
-        // address of the first block of the pool
-        pools_list[i].pool_start = (block_t *) &(g_pool_heap[index]);
-        pools_list[i].pool_curr =  (block_t *) &(g_pool_heap[index]);
+    size_t i = __atomic_load_n(&ctx->page_pool[offset >> ctx->page_shift],
+                               __ATOMIC_RELAXED);
+    if (i >= ctx->num_pools) {
+        // in the unused bytes after the last pool, or in an unused span
+        return ctx->num_pools;
+    }
 
-        // number of blocks of that size that fit in the pool
-        block_count = max_pool_size/(block_sizes[i]);
-        // number of unused bytes of space in a pool
-        space_wastage = max_pool_size - (block_count * block_sizes[i]);
-        // index of the last block of the pool
-        end_index = index + max_pool_size - block_sizes[i] - space_wastage;
+    pool_t *pool = &ctx->pools_list[i];
+    if (ctx->use_spans) {
+        size_t span_size = (size_t) 1 << ctx->page_shift;
+        size_t rel = offset & (span_size - 1);
 
-        // address of the last block of the pool
-        pools_list[i].pool_end = (block_t *) &(g_pool_heap[end_index]);
+        if (rel + pool->pool_block_size > span_size ||
+            !recip_divisible(rel, pool->pool_recip)) {
+            return ctx->num_pools;
+        }
+        return i;
+    }
+    size_t rel = (uintptr_t) block - (uintptr_t) pool->pool_start;
 
-        index += max_pool_size;
+    // interior pointers and the unused bytes at the end of the pool
+    if (block > __atomic_load_n(&pool->pool_end, __ATOMIC_RELAXED) ||
+        !recip_divisible(rel, pool->pool_recip)) {
+        return ctx->num_pools;
     }
-    return true;
+    return i;
 }
 
-/* @brief allocates an object of size n on the g_pool_heap if
- * n is less than or equal to the size of blocks in a certain
- * pool and the pool has space. Else fails
- *
+/* @brief checks whether a block lies within a pool, without checking
+ * that it is the start of a block
  *
- * param[in] n: size of the object that is to be allocated
+ * param[in] ctx: the allocator context
+ * param[in] i: the index of the pool
+ * param[in] block: the address of the block
  *
- * returns the address of the allocated memory or NULL
+ * returns true if the block is in the pool
+*/
+
+static inline bool in_pool(pool_ctx_t *ctx, size_t i, block_t *block)
+{
+    pool_t *pool = &ctx->pools_list[i];
+
+    if (ctx->use_spans) {
+        size_t offset = (uintptr_t) block - (uintptr_t) ctx->heap;
+        return (offset >> ctx->page_shift) <
+            (ctx->heap_size >> ctx->page_shift) &&
+            __atomic_load_n(&ctx->page_pool[offset >> ctx->page_shift],
+                            __ATOMIC_RELAXED) == i;
+    }
+    return block >= pool->pool_start &&
+        block <= __atomic_load_n(&pool->pool_end, __ATOMIC_RELAXED);
+}
+
+/* @brief aborts if a block given to a sized free isn't the start of a
+ * block large enough for n, when compiled with POOL_DEBUG
  *
- * Time Complexity: O(1)
+ * param[in] ctx: the allocator context
+ * param[in] block: the address of the block, NULL is accepted
+ * param[in] n: the size the block was allocated with
 */
 
-void *pool_malloc(size_t n)
+static inline void debug_check_sized(pool_ctx_t *ctx, block_t *block,
+                                     size_t n)
 {
-    // returns NULL if n is greater than the size of blocks in the largest pool
-    if (n > pools_list[num_pools-1].pool_block_size || n < 1) {
-        return NULL;
+#ifdef POOL_DEBUG
+    if (block == NULL) {
+        return;
     }
 
-    for (size_t i = 0; i < num_pools; i++) {
-        block_t *block = find_fit(i, n);
-        if (block != NULL) {
-            return (void *) block->payload;
-        }
+    size_t i = find_pool(ctx, block);
+    if (i == ctx->num_pools) {
+        fprintf(stderr, "pool_free_sized: %p is not an allocated block\n",
+                (void *) block);
+        abort();
     }
-    return NULL;
+    if (ctx->pools_list[i].pool_block_size < n) {
+        fprintf(stderr, "pool_free_sized: %p holds %zu bytes, not %zu\n",
+                (void *) block, ctx->pools_list[i].pool_block_size, n);
+        abort();
+    }
+#else
+    (void) ctx;
+    (void) block;
+    (void) n;
+#endif
 }
 
-/* @brief frees an allocated object on the g_pool_heap so that
- * the memory can be re-used
+/* @brief adds to a counter of the calling thread's cache
  *
- * param[in] ptr: the address to allocated memory to be freed
+ * Only the owning thread writes the counter and pool_get_stats only
+ * reads it, so a relaxed store is enough and no atomic add is needed.
  *
- * Time Complexity: O(1)
+ * param[in] counter: the counter
+ * param[in] n: the amount to add
 */
 
-void pool_free(void *ptr)
+static inline void stat_add(uint64_t *counter, uint64_t n)
 {
-    block_t *block = (block_t *) ptr;
+    __atomic_store_n(counter, *counter + n, __ATOMIC_RELAXED);
+}
+
+/* @brief counts blocks taken from a shared pool
+ *
+ * param[in] pool: the pool
+ * param[in] count: the number of blocks taken
+ * param[in] fresh: how many of those were never allocated before
+*/
 
-    // Cases for if block is NULL or outside of the heap
-    if (block == NULL || block < pools_list[0].pool_start ||
-        block > pools_list[num_pools-1].pool_end) {
+static void stats_take(pool_t *pool, size_t count, size_t fresh)
+{
+    if (count == 0) {
         return;
     }
 
-     for (size_t i = 0; i < num_pools; i++) {
-        // checks if the block is between the first and last block of a certain
-        // pool
-        if (block >= pools_list[i].pool_start && block <= pools_list[i].pool_end) {
-            add_to_pool(i, block);
-            break;
-        }
+    uint64_t taken = __atomic_add_fetch(&pool->pool_taken, count,
+                                        __ATOMIC_RELAXED);
+    uint64_t peak = __atomic_load_n(&pool->pool_drawn_peak,
+                                    __ATOMIC_RELAXED);
+    while (taken > peak &&
+           !__atomic_compare_exchange_n(&pool->pool_drawn_peak, &peak, taken,
+                                        true, __ATOMIC_RELAXED,
+                                        __ATOMIC_RELAXED)) {
+    }
+    if (fresh != 0) {
+        __atomic_add_fetch(&pool->pool_carved, fresh, __ATOMIC_RELAXED);
     }
 }
 
+/* @brief counts blocks given back to a shared pool
+ *
+ * param[in] pool: the pool
+ * param[in] count: the number of blocks given back
+*/
+
+static void stats_give(pool_t *pool, size_t count)
+{
+    __atomic_sub_fetch(&pool->pool_taken, count, __ATOMIC_RELAXED);
+}
+
+/* @brief adds the counters of a thread cache to those of another
+ *
+ * param[in] sum: the cache adding up the counters, not a live one
+ * param[in] tc: the cache whose counters are added, possibly of another
+ * thread that is still counting
+*/
+
+static void stats_sum(tcache_t *sum, tcache_t *tc)
+{
+    sum->oversized += __atomic_load_n(&tc->oversized, __ATOMIC_RELAXED);
+    for (size_t i = 0; i < MAX_NUM_POOLS; i++) {
+        tcache_bin_t *bin = &tc->bins[i];
+        sum->bins[i].allocs += __atomic_load_n(&bin->allocs,
+                                               __ATOMIC_RELAXED);
+        sum->bins[i].frees += __atomic_load_n(&bin->frees,
+                                              __ATOMIC_RELAXED);
+        sum->bins[i].failed += __atomic_load_n(&bin->failed,
+                                               __ATOMIC_RELAXED);
+        sum->bins[i].spills += __atomic_load_n(&bin->spills,
+                                               __ATOMIC_RELAXED);
+        sum->bins[i].requested += __atomic_load_n(&bin->requested,
+                                                  __ATOMIC_RELAXED);
+    }
+    for (size_t b = 0; b < POOL_HIST_BUCKETS; b++) {
+        sum->histogram[b] += __atomic_load_n(&tc->histogram[b],
+                                             __ATOMIC_RELAXED);
+    }
+}
 
+/* @brief zeroes the cached blocks and the counters of a thread cache
+*/
+
+static void stats_reset(tcache_t *tc)
+{
+    memset(tc->bins, 0, sizeof(tc->bins));
+    memset(tc->histogram, 0, sizeof(tc->histogram));
+    tc->oversized = 0;
+}
+
+/* @brief gives every block cached by a thread back to the shared pools
+ *
+ * param[in] tc: the thread cache to empty
+*/
+
+static void tcache_drain(tcache_t *tc)
+{
+    if (tc->epoch != g_pool_ctx.epoch) {
+        // blocks of an earlier layout, the heap they pointed into has
+        // been handed out again by pool_init, and counters of its pools
+        stats_reset(tc);
+        return;
+    }
+
+    for (size_t i = 0; i < g_pool_ctx.num_pools; i++) {
+        tcache_bin_t *bin = &tc->bins[i];
+        if (bin->count == 0) {
+            continue;
+        }
+        block_t *tail = bin->head;
+        while (tail->next != NULL) {
+            tail = tail->next;
+        }
+        add_to_pool(&g_pool_ctx, i, bin->head, tail);
+        stats_give(&g_pool_ctx.pools_list[i], bin->count);
+        bin->head = NULL;
+        bin->count = 0;
+        bin->fresh = 0;
+    }
+}
+
+/* @brief thread exit hook, returns the cached blocks of the exiting
+ * thread to the shared pools
+ *
+ * param[in] arg: the thread cache of the exiting thread
+*/
+
+static void tcache_exit(void *arg)
+{
+    tcache_t *tc = (tcache_t *) arg;
+
+    tcache_drain(tc);
+
+    // keeps the counters of the thread for pool_get_stats
+    pthread_mutex_lock(&stats_lock);
+    if (tc->epoch == g_pool_ctx.epoch) {
+        stats_sum(&retired, tc);
+    }
+    if (tc->prev != NULL) {
+        tc->prev->next = tc->next;
+    }
+    else {
+        tcache_list = tc->next;
+    }
+    if (tc->next != NULL) {
+        tc->next->prev = tc->prev;
+    }
+    // the thread may still free blocks in other exit hooks, which
+    // registers its cache again
+    tc->registered = false;
+    stats_reset(tc);
+    pthread_mutex_unlock(&stats_lock);
+}
+
+static void tcache_key_create(void)
+{
+    pthread_key_create(&tcache_key, tcache_exit);
+}
+
+/* @brief returns the thread cache of the calling thread, emptied if
+ * it still holds blocks from before the latest pool_init
+*/
+
+static tcache_t *tcache_get(void)
+{
+    tcache_t *tc = &pool_tcache;
+
+    if (tc->epoch != g_pool_ctx.epoch) {
+        tcache_drain(tc);
+        // released so pool_get_stats sees the counters zeroed first
+        __atomic_store_n(&tc->epoch, g_pool_ctx.epoch, __ATOMIC_RELEASE);
+    }
+    if (!tc->registered) {
+        // set first, pthread_setspecific may allocate, and that
+        // allocation may be served by this allocator when it replaces
+        // malloc
+        tc->registered = true;
+        pthread_once(&tcache_key_once, tcache_key_create);
+        pthread_setspecific(tcache_key, tc);
+
+        pthread_mutex_lock(&stats_lock);
+        tc->prev = NULL;
+        tc->next = tcache_list;
+        if (tcache_list != NULL) {
+            tcache_list->prev = tc;
+        }
+        tcache_list = tc;
+        pthread_mutex_unlock(&stats_lock);
+    }
+    return tc;
+}
+
+/* @brief refills an empty bin of a thread cache from its shared pool
+ *
+ * param[in] tc: the thread cache
+ * param[in] i: the index of the pool
+ *
+ * returns the number of blocks now in the bin
+*/
+
+static size_t tcache_refill(tcache_t *tc, size_t i)
+{
+    tcache_bin_t *bin = &tc->bins[i];
+
+    bin->count = find_fit(&g_pool_ctx, i,
+                          g_pool_ctx.pools_list[i].pool_batch, &bin->head,
+                          &bin->fresh);
+    stats_take(&g_pool_ctx.pools_list[i], bin->count, bin->fresh);
+    return bin->count;
+}
+
+/* @brief gives the pool_batch least recently cached blocks of a bin
+ * back to its shared pool
+ *
+ * param[in] tc: the thread cache
+ * param[in] i: the index of the pool
+*/
+
+static void tcache_flush(tcache_t *tc, size_t i)
+{
+    tcache_bin_t *bin = &tc->bins[i];
+    size_t keep = bin->count - g_pool_ctx.pools_list[i].pool_batch;
+    block_t *cut = bin->head;
+
+    for (size_t k = 1; k < keep; k++) {
+        cut = cut->next;
+    }
+    block_t *head = cut->next;
+    block_t *tail = head;
+    while (tail->next != NULL) {
+        tail = tail->next;
+    }
+    cut->next = NULL;
+    // the blocks given back are the bottom of the stack
+    bin->fresh = bin->fresh > bin->count - keep ?
+        bin->fresh - (bin->count - keep) : 0;
+    bin->count = keep;
+
+    add_to_pool(&g_pool_ctx, i, head, tail);
+    stats_give(&g_pool_ctx.pools_list[i],
+               g_pool_ctx.pools_list[i].pool_batch);
+}
+
+/* @brief frees a block of a pool into the calling thread's cache,
+ * giving a batch back to the shared pool when the cache grows too large
+ *
+ * param[in] i: the index of the pool
+ * param[in] block: the address of the block
+*/
+
+static void tcache_put(size_t i, block_t *block)
+{
+    tcache_t *tc = tcache_get();
+    tcache_bin_t *bin = &tc->bins[i];
+
+    stat_add(&bin->frees, 1);
+    block->next = bin->head;
+    bin->head = block;
+    if (++bin->count > 2 * g_pool_ctx.pools_list[i].pool_batch) {
+        tcache_flush(tc, i);
+    }
+}
+
+/* @brief finds the alignment of the blocks of a pool
+ *
+ * returns the largest power of two, up to MAX_ALIGN, that the block
+ * size is a multiple of
+*/
+
+static inline size_t pool_align(pool_t *pool)
+{
+    size_t align = pool->pool_block_size & -pool->pool_block_size;
+
+    return align > MAX_ALIGN ? MAX_ALIGN : align;
+}
+
+/* @brief checks that an alignment is a power of two no larger than the
+ * alignment pools can guarantee
+*/
+
+static inline bool valid_align(size_t alignment)
+{
+    return alignment != 0 && (alignment & (alignment - 1)) == 0 &&
+        alignment <= MAX_ALIGN;
+}
+
+/* @brief allocates an object of size n from the calling thread's cache,
+ * refilling it from the shared pool when it is empty
+ *
+ * param[in] n: size of the object that is to be allocated, at least 1
+ * param[in] alignment: the alignment the blocks of the pool must have
+ * param[out] zeroed: whether the block was never allocated before and
+ * so is zero apart from its next pointer, may be NULL
+ *
+ * returns the address of the allocated memory or NULL
+*/
+
+static inline void *tcache_alloc(size_t n, size_t alignment, bool *zeroed)
+{
+    tcache_t *tc = tcache_get();
+    size_t first = size_class(&g_pool_ctx, n);
+
+    stat_add(&tc->histogram[pool_hist_bucket(n)], 1);
+
+    // a full pool spills into the pools of larger blocks, returns NULL
+    // if n is greater than the size of blocks in the largest pool
+    for (size_t i = first; i < g_pool_ctx.num_pools; i++) {
+        tcache_bin_t *bin = &tc->bins[i];
+        if (pool_align(&g_pool_ctx.pools_list[i]) < alignment ||
+            (bin->count == 0 && tcache_refill(tc, i) == 0)) {
+            continue;
+        }
+        block_t *block = bin->head;
+        if (zeroed != NULL) {
+            *zeroed = bin->count <= bin->fresh;
+        }
+        bin->head = block->next;
+        bin->count--;
+        if (bin->fresh > bin->count) {
+            bin->fresh = bin->count;
+        }
+        stat_add(&bin->allocs, 1);
+        stat_add(&bin->requested, n);
+        if (i != first) {
+            stat_add(&tc->bins[first].spills, 1);
+        }
+        return (void *) block->payload;
+    }
+
+    if (first < g_pool_ctx.num_pools) {
+        stat_add(&tc->bins[first].failed, 1);
+    }
+    else {
+        stat_add(&tc->oversized, 1);
+    }
+    return NULL;
+}
+
+/* @brief allocates an object of size n straight from the pools of an
+ * allocator context
+ *
+ * param[in] ctx: the allocator context
+ * param[in] n: size of the object that is to be allocated, at least 1
+ * param[in] alignment: the alignment the blocks of the pool must have
+ * param[out] zeroed: whether the block was never allocated before and
+ * so is zero apart from its next pointer, may be NULL
+ *
+ * returns the address of the allocated memory or NULL
+*/
+
+static void *ctx_alloc(pool_ctx_t *ctx, size_t n, size_t alignment,
+                       bool *zeroed)
+{
+    size_t fresh;
+
+    // a full pool spills into the pools of larger blocks, returns NULL
+    // if n is greater than the size of blocks in the largest pool
+    for (size_t i = size_class(ctx, n); i < ctx->num_pools; i++) {
+        block_t *block;
+        if (pool_align(&ctx->pools_list[i]) >= alignment &&
+            find_fit(ctx, i, 1, &block, &fresh) != 0) {
+            if (zeroed != NULL) {
+                *zeroed = fresh != 0;
+            }
+            return (void *) block->payload;
+        }
+    }
+    return NULL;
+}
+
+/* @brief allocates count blocks of at least n bytes, taking them off
+ * the pools as whole chains
+ *
+ * param[in] ctx: the allocator context
+ * param[in] tc: the thread cache emptied first, NULL to go straight to
+ * the pools
+ * param[in] n: size of the objects that are to be allocated
+ * param[out] out: the addresses of the allocated memory
+ * param[in] count: the number of objects
+ *
+ * returns the number of objects allocated, fewer than count if the
+ * pools that fit n ran out
+*/
+
+static size_t malloc_batch(pool_ctx_t *ctx, tcache_t *tc, size_t n,
+                           void **out, size_t count)
+{
+    size_t filled = 0, fresh;
+    size_t first = size_class(ctx, n);
+
+    if (n < 1) {
+        return 0;
+    }
+
+    for (size_t i = first; i < ctx->num_pools && filled < count; i++) {
+        size_t start = filled;
+
+        if (tc != NULL) {
+            tcache_bin_t *bin = &tc->bins[i];
+            for (; filled < count && bin->count > 0; bin->count--) {
+                out[filled++] = bin->head->payload;
+                bin->head = bin->head->next;
+            }
+            if (bin->fresh > bin->count) {
+                bin->fresh = bin->count;
+            }
+        }
+
+        if (filled < count) {
+            // one compare-and-swap, or one lock for pools made of spans,
+            // for the rest of the batch
+            block_t *block;
+            size_t got = find_fit(ctx, i, count - filled, &block, &fresh);
+            for (; block != NULL; block = block->next) {
+                out[filled++] = block->payload;
+            }
+            if (tc != NULL) {
+                stats_take(&ctx->pools_list[i], got, fresh);
+            }
+        }
+
+        if (tc != NULL) {
+            stat_add(&tc->bins[i].allocs, filled - start);
+            stat_add(&tc->bins[i].requested, n * (filled - start));
+            if (i != first) {
+                stat_add(&tc->bins[first].spills, filled - start);
+            }
+        }
+    }
+
+    if (tc != NULL) {
+        stat_add(&tc->histogram[pool_hist_bucket(n)], count);
+    }
+    if (tc != NULL && filled < count) {
+        if (first < ctx->num_pools) {
+            stat_add(&tc->bins[first].failed, count - filled);
+        }
+        else {
+            stat_add(&tc->oversized, count - filled);
+        }
+    }
+    return filled;
+}
+
+/* @brief counts a run of blocks free_batch gave back to pool i
+*/
+
+static inline void free_batch_stats(pool_ctx_t *ctx, tcache_t *tc, size_t i,
+                                    size_t length)
+{
+    if (tc != NULL) {
+        stat_add(&tc->bins[i].frees, length);
+        stats_give(&ctx->pools_list[i], length);
+    }
+}
+
+/* @brief frees count objects, giving each run of objects from the
+ * same pool back to it as one chain
+ *
+ * param[in] ctx: the allocator context
+ * param[in] tc: the thread cache counting the frees, NULL for instances
+ * param[in] ptrs: the addresses of the objects, invalid ones are skipped
+ * param[in] count: the number of addresses
+ *
+ * returns the number of objects freed
+*/
+
+static size_t free_batch(pool_ctx_t *ctx, tcache_t *tc, void **ptrs,
+                         size_t count)
+{
+    block_t *head = NULL, *tail = NULL;
+    size_t run = ctx->num_pools, freed = 0, length = 0;
+
+    for (size_t k = 0; k < count; k++) {
+        block_t *block = (block_t *) ptrs[k];
+        size_t i = find_pool(ctx, block);
+
+        if (i == ctx->num_pools) {
+            continue;
+        }
+        if (i != run) {
+            if (head != NULL) {
+                add_to_pool(ctx, run, head, tail);
+                free_batch_stats(ctx, tc, run, length);
+            }
+            tail = block;
+            run = i;
+            length = 0;
+        }
+        else {
+            block->next = head;
+        }
+        head = block;
+        length++;
+        freed++;
+    }
+    if (head != NULL) {
+        add_to_pool(ctx, run, head, tail);
+        free_batch_stats(ctx, tc, run, length);
+    }
+    return freed;
+}
+
+/* @brief finds the size of the pages pools start and end on
+ *
+ * param[in] heap_size: size in bytes of the heap
+ * param[in] growable: whether pools must start on a system page
+ *
+ * returns log2 of the page size
+*/
+
+static size_t page_shift_for(size_t heap_size, bool growable)
+{
+    size_t shift = MIN_PAGE_SHIFT;
+
+    if (growable) {
+        shift = __builtin_ctzll(sysconf(_SC_PAGESIZE));
+    }
+    // a last partial page needs an entry in the page map as well
+    while (((heap_size + ((size_t) 1 << shift) - 1) >> shift) > MAP_PAGES) {
+        shift++;
+    }
+    return shift;
+}
+
+/* @brief rounds block sizes up to a multiple of 8 and sorts them, and
+ * the weights that go with them, into increasing block size
+ *
+ * Every block then starts on a multiple of 8 from the start of its
+ * pool, and pools start on a page of a heap aligned to MAX_ALIGN, so a
+ * block is aligned to the largest power of two its size is a multiple
+ * of, up to MAX_ALIGN.
+ *
+ * param[in] block_sizes: the block sizes
+ * param[in] weights: the weights, NULL for equal weights
+ * param[in] block_size_count: the number of block sizes
+ * param[out] sizes: the sorted block sizes
+ * param[out] sorted_weights: the sorted weights
+*/
+
+static void sort_pools(const size_t *block_sizes, const size_t *weights,
+                       size_t block_size_count, size_t *sizes,
+                       size_t *sorted_weights)
+{
+    for (size_t i = 0; i < block_size_count; i++) {
+        size_t size = (block_sizes[i] + 7) & ~(size_t) 7;
+        size_t j = i;
+        for (; j > 0 && sizes[j-1] > size; j--) {
+            sizes[j] = sizes[j-1];
+            sorted_weights[j] = sorted_weights[j-1];
+        }
+        sizes[j] = size;
+        sorted_weights[j] = weights == NULL ? 1 : weights[i];
+    }
+}
+
+/* @brief splits the pages of a heap between pools in proportion to
+ * their weights
+ *
+ * param[in] weights: the weight of each pool
+ * param[in] block_size_count: the number of pools
+ * param[in] heap_pages: the number of pages in the heap
+ * param[out] first_page: the first page of each pool, followed by the
+ * page after the last pool
+*/
+
+static void split_pages(const size_t *weights, size_t block_size_count,
+                        size_t heap_pages, size_t *first_page)
+{
+    __uint128_t total = 0, sum = 0;
+
+    for (size_t i = 0; i < block_size_count; i++) {
+        total += weights[i];
+    }
+    for (size_t i = 0; i <= block_size_count; i++) {
+        first_page[i] = (size_t) (heap_pages * sum / total);
+        if (i < block_size_count) {
+            sum += weights[i];
+        }
+    }
+}
+
+/* @brief builds the size class tables of a context
+ *
+ * param[in] ctx: the allocator context
+ * param[in] block_sizes: the block sizes of its pools, sorted
+ * param[in] block_size_count: the number of pools
+*/
+
+static void build_class_tables(pool_ctx_t *ctx, const size_t *block_sizes,
+                               size_t block_size_count)
+{
+    // each entry holds the first pool with blocks at least as large as
+    // the smallest size that maps to it
+    size_t i = 0;
+    for (size_t k = 0; k < NUM_SMALL_CLASSES; k++) {
+        while (i < block_size_count && block_sizes[i] + 7 < 8*k) {
+            i++;
+        }
+        ctx->small_class[k] = i;
+    }
+    i = 0;
+    for (size_t b = 0; b < NUM_LARGE_CLASSES; b++) {
+        while (i < block_size_count && block_sizes[i] <= ((size_t) 1 << b)) {
+            i++;
+        }
+        ctx->large_class[b] = i;
+    }
+}
+
+/* @brief copies the epoch and small_class table of the global context
+ * to pool_fast, read by the inline pool_malloc in pool_alloc_inline.h,
+ * and forgets the counters of exited threads along with the old pools
+ *
+ * param[in] ctx: the allocator context, nothing is copied unless it is
+ * g_pool_ctx
+*/
+
+static void publish_fast(pool_ctx_t *ctx)
+{
+    if (ctx != &g_pool_ctx) {
+        return;
+    }
+    memcpy(pool_fast.small_class, ctx->small_class,
+           sizeof(pool_fast.small_class));
+    // a traced build leaves the epoch behind, so that the inline
+    // pool_malloc always calls pool_malloc, which records the call
+#ifndef POOL_TRACE
+    __atomic_store_n(&pool_fast.epoch, ctx->epoch, __ATOMIC_RELEASE);
+#endif
+
+    pthread_mutex_lock(&stats_lock);
+    memset(&retired, 0, sizeof(retired));
+    pthread_mutex_unlock(&stats_lock);
+}
+
+/* @brief finds the size of the spans of a heap: a page of the heap
+ * that is at least 2^SPAN_MIN_SHIFT bytes and fits the largest block
+ *
+ * param[in] block_sizes: the block sizes, sorted
+ * param[in] block_size_count: the number of block sizes
+ * param[in] heap_size: size in bytes of the heap
+ * param[in] growable: whether spans must start on a system page
+ *
+ * returns log2 of the span size, or 0 if the parameters are invalid or
+ * the heap can't hold a single span
+*/
+
+static size_t span_shift_for(const size_t *block_sizes,
+                             size_t block_size_count, size_t heap_size,
+                             bool growable)
+{
+    size_t shift = page_shift_for(heap_size, growable);
+
+    if (block_size_count > MAX_NUM_POOLS || block_size_count == 0
+        || block_sizes[0] == 0) {
+        return 0;
+    }
+    if (shift < SPAN_MIN_SHIFT) {
+        shift = SPAN_MIN_SHIFT;
+    }
+    while (((size_t) 1 << shift) < block_sizes[block_size_count-1]) {
+        shift++;
+    }
+    return (heap_size >> shift) == 0 ? 0 : shift;
+}
+
+/* @brief Checks the parameters provided for initialization of the pools
+ *
+ * param[in] block_sizes: A list containing the payload sizes
+ * of the blocks in each respective pool
+ * param[in] weights: A list containing the share of the heap given to
+ * each respective pool, NULL to share it equally
+ * param[in] block_sizes_count: Number of differently sized blocks possible
+ * param[in] heap_size: size in bytes of the heap the pools are carved from
+ * param[in] page_shift: log2 of the size of the pages pools start on
+ * returns true if parameters are appropriate, else returns false
+ *
+ * Pool initialization fails if:
+ * ~ number of block sizes is < 1
+ * ~ number of block sizes is > 64
+ * ~ the list containing block sizes is NULL
+ * ~ a weight is 0
+ * ~ the pools are too small to store a pointer
+ * ~ block sizes small enough that each pool can atleast store one block
+ */
+
+bool param_verif(const size_t *block_sizes, const size_t *weights,
+                 size_t block_size_count, size_t heap_size,
+                 size_t page_shift)
+{
+    size_t sizes[MAX_NUM_POOLS], sorted_weights[MAX_NUM_POOLS];
+    size_t first_page[MAX_NUM_POOLS + 1];
+
+    if (block_size_count > MAX_NUM_POOLS || block_size_count == 0
+        || block_sizes == NULL) {
+        return false;
+    }
+
+    sort_pools(block_sizes, weights, block_size_count, sizes,
+               sorted_weights);
+    for (size_t i = 0; i < block_size_count; i++) {
+        if (sorted_weights[i] == 0) {
+            return false;
+        }
+    }
+    split_pages(sorted_weights, block_size_count, heap_size >> page_shift,
+                first_page);
+
+    for (size_t i = 0; i < block_size_count; i++) {
+        size_t pool_size = (first_page[i+1] - first_page[i]) << page_shift;
+
+        if (pool_size < sizeof(block_t)) {
+            return false;
+        }
+        // checks if atleast 1 block can fit in the pool
+        if (sizes[i] == 0 || pool_size/(sizes[i]) < 1) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+#ifdef POOL_TRACE
+
+/* Tracing:
+ * Compiled with POOL_TRACE, every call on the global pools is recorded,
+ * see pool_trace.h for the format. Each thread appends its records to a
+ * ring of its own without locking, and trace_flusher, a thread started
+ * by the first record, copies the rings to the trace file every
+ * TRACE_FLUSH_NS nanoseconds. A thread that fills its ring copies it out
+ * itself, so no record is lost.
+ *
+ * trace_rings links the rings, guarded by trace_lock. A ring is unmapped
+ * once its thread has exited and it has been copied. Rings are mapped
+ * rather than allocated with malloc, which may be pool_malloc itself
+ * under the LD_PRELOAD library, and the calls a thread makes while it
+ * sets up tracing aren't recorded for the same reason.
+*/
+
+typedef struct trace_ring {
+    pool_trace_record_t records[TRACE_RING_SIZE];
+    uint64_t head;
+    uint64_t tail;
+    bool exited;
+    uint16_t thread;
+    struct trace_ring *next;
+} trace_ring_t;
+
+static pthread_once_t trace_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t trace_key;
+static pthread_t trace_thread;
+static trace_ring_t *trace_rings;
+static int trace_fd = -1;
+static bool trace_stopping;
+static uint64_t trace_start;
+static uint16_t trace_threads;
+static _Thread_local trace_ring_t *trace_ring;
+static _Thread_local bool in_trace;
+
+static uint64_t trace_now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/* @brief writes len bytes to the trace file, giving up on errors
+*/
+
+static void trace_write(const void *buf, size_t len)
+{
+    const uint8_t *bytes = (const uint8_t *) buf;
+
+    while (len > 0) {
+        ssize_t written = write(trace_fd, bytes, len);
+        if (written <= 0) {
+            return;
+        }
+        bytes += written;
+        len -= written;
+    }
+}
+
+/* @brief copies the records of every ring to the trace file, and unmaps
+ * the rings of threads that exited, with trace_lock held
+*/
+
+static void trace_drain(void)
+{
+    trace_ring_t **link = &trace_rings;
+
+    while (*link != NULL) {
+        trace_ring_t *ring = *link;
+        // read before head, so that no record follows the last one read
+        bool exited = __atomic_load_n(&ring->exited, __ATOMIC_ACQUIRE);
+        uint64_t tail = ring->tail;
+        uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+        // in at most two pieces, if the records wrap around the ring
+        while (tail != head) {
+            size_t start = tail % TRACE_RING_SIZE;
+            size_t count = head - tail;
+            if (count > TRACE_RING_SIZE - start) {
+                count = TRACE_RING_SIZE - start;
+            }
+            if (trace_fd >= 0) {
+                trace_write(&ring->records[start],
+                            count * sizeof(pool_trace_record_t));
+            }
+            tail += count;
+        }
+        __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+
+        if (exited) {
+            *link = ring->next;
+            munmap(ring, sizeof(trace_ring_t));
+        }
+        else {
+            link = &ring->next;
+        }
+    }
+}
+
+static void *trace_flusher(void *arg)
+{
+    struct timespec delay = {0, TRACE_FLUSH_NS};
+    bool stopping;
+
+    do {
+        nanosleep(&delay, NULL);
+        pthread_mutex_lock(&trace_lock);
+        stopping = trace_stopping;
+        trace_drain();
+        pthread_mutex_unlock(&trace_lock);
+    } while (!stopping);
+    return arg;
+}
+
+// stops trace_flusher after one last copy, when the program exits
+static void trace_stop(void)
+{
+    pthread_mutex_lock(&trace_lock);
+    trace_stopping = true;
+    pthread_mutex_unlock(&trace_lock);
+    pthread_join(trace_thread, NULL);
+}
+
+// the destructor of trace_key, a ring is unmapped after its thread exits
+static void trace_exit(void *arg)
+{
+    __atomic_store_n(&((trace_ring_t *) arg)->exited, true,
+                     __ATOMIC_RELEASE);
+    trace_ring = NULL;
+}
+
+/* @brief opens the trace file named by POOL_TRACE_FILE and starts
+ * trace_flusher, run once by the first thread that records
+*/
+
+static void trace_begin(void)
+{
+    const char *path = getenv("POOL_TRACE_FILE");
+    pool_trace_header_t header = {
+        .record_size = sizeof(pool_trace_record_t)
+    };
+
+    memcpy(header.magic, POOL_TRACE_MAGIC, sizeof(header.magic));
+    trace_start = trace_now();
+    trace_fd = open(path != NULL ? path : "pool_trace.bin",
+                    O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (trace_fd >= 0) {
+        trace_write(&header, sizeof(header));
+    }
+    pthread_key_create(&trace_key, trace_exit);
+    if (pthread_create(&trace_thread, NULL, trace_flusher, NULL) == 0) {
+        atexit(trace_stop);
+    }
+}
+
+/* @brief returns the ring of the calling thread, mapping one on its
+ * first record
+*/
+
+static trace_ring_t *trace_ring_get(void)
+{
+    if (trace_ring != NULL) {
+        return trace_ring;
+    }
+
+    in_trace = true;
+    pthread_once(&trace_once, trace_begin);
+    trace_ring_t *ring = mmap(NULL, sizeof(trace_ring_t),
+                              PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring != MAP_FAILED) {
+        pthread_mutex_lock(&trace_lock);
+        ring->thread = ++trace_threads;
+        ring->next = trace_rings;
+        trace_rings = ring;
+        pthread_mutex_unlock(&trace_lock);
+
+        trace_ring = ring;
+        pthread_setspecific(trace_key, ring);
+    }
+    in_trace = false;
+    return trace_ring;
+}
+
+/* @brief appends a record to the ring of the calling thread
+ *
+ * param[in] op: the call, one of the POOL_TRACE_ ops
+ * param[in] flags: the flags of the record
+ * param[in] size: the size of the record
+ * param[in] offset: the offset of the record
+*/
+
+static void trace_record(uint8_t op, uint8_t flags, uint64_t size,
+                         uint32_t offset)
+{
+    if (in_trace) {
+        return;
+    }
+    trace_ring_t *ring = trace_ring_get();
+    if (ring == NULL) {
+        return;
+    }
+
+    uint64_t head = ring->head;
+    if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) ==
+        TRACE_RING_SIZE) {
+        pthread_mutex_lock(&trace_lock);
+        trace_drain();
+        pthread_mutex_unlock(&trace_lock);
+    }
+    ring->records[head % TRACE_RING_SIZE] = (pool_trace_record_t) {
+        .time = trace_now() - trace_start,
+        .size = size,
+        .offset = offset,
+        .thread = ring->thread,
+        .op = op,
+        .flags = flags
+    };
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+#endif
+
+/* @brief records a call on the global pools, when compiled with
+ * POOL_TRACE
+ *
+ * param[in] op: the call, one of the POOL_TRACE_ ops
+ * param[in] size: the size passed to the call
+ * param[in] ptr: the object allocated or freed, NULL for none
+*/
+
+static inline void trace_op(uint8_t op, size_t size, const void *ptr)
+{
+#ifdef POOL_TRACE
+    uintptr_t offset = (uintptr_t) ptr - (uintptr_t) g_pool_ctx.heap;
+
+    trace_record(op, 0, size, offset < g_pool_ctx.heap_size ?
+                 (uint32_t) offset : POOL_TRACE_NULL);
+#else
+    (void) op;
+    (void) size;
+    (void) ptr;
+#endif
+}
+
+/* @brief records an initialization of the global pools, when compiled
+ * with POOL_TRACE
+ *
+ * param[in] ctx: the allocator context, nothing is recorded unless it is
+ * g_pool_ctx
+ * param[in] block_sizes: the block sizes, sorted
+ * param[in] weights: the weight of each pool, NULL for pools made of spans
+ * param[in] block_size_count: the number of block sizes
+*/
+
+static inline void trace_init(pool_ctx_t *ctx, const size_t *block_sizes,
+                              const size_t *weights, size_t block_size_count)
+{
+#ifdef POOL_TRACE
+    if (ctx != &g_pool_ctx) {
+        return;
+    }
+
+    uint8_t flags = (ctx->growable ? POOL_TRACE_GROWABLE : 0) |
+        (ctx->use_spans ? POOL_TRACE_SPANS : 0) |
+        (ctx->eager ? POOL_TRACE_EAGER : 0);
+    trace_record(POOL_TRACE_INIT, flags, ctx->heap_size, block_size_count);
+    for (size_t i = 0; i < block_size_count; i++) {
+        size_t weight = weights != NULL ? weights[i] : 1;
+        trace_record(POOL_TRACE_INIT_SIZE, 0, block_sizes[i],
+                     weight < POOL_TRACE_NULL ? weight : POOL_TRACE_NULL);
+    }
+#else
+    (void) ctx;
+    (void) block_sizes;
+    (void) weights;
+    (void) block_size_count;
+#endif
+}
+
+
+/* Main Functions */
+
+
+/* @brief Initializes the pools of an allocator context based on
+ * input parameters
+ *
+ * param[in] ctx: the allocator context
+ * param[in] block_sizes: A list containing the payload sizes
+ * of the blocks in each respective pool
+ * param[in] weights: A list containing the share of the heap given to
+ * each respective pool, NULL to share it equally
+ * param[in] block_sizes_count: Number of differently sized blocks possible
+ * param[in] eager: whether to thread the free lists through every block
+ * and touch every page now instead of as blocks are first taken
+ *
+ * returns true if initialization is succesful
+ * else returns false
+ *
+ * Precondition: len(block_sizes) == len(weights) == block_size_count
+ *
+ * Potential existance of bytes that can't be utilized:
+ *
+ * Depending on the size values in the block_sizes array there may be
+ * bytes that will remain unused or wasted. The only case where
+ * this won't happen is if the size of every pool is perfectly
+ * divisible by its block size.
+ *
+ * Time Complexity: O(1), or O(heap_size) when eager
+ *
+ * */
+
+static bool init_pools(pool_ctx_t *ctx, const size_t *block_sizes,
+                       const size_t *weights, size_t block_size_count,
+                       bool eager)
+{
+
+    size_t index, end_index, block_count, space_wastage, max_pool_size;
+    size_t mapped, page_size;
+    size_t sizes[MAX_NUM_POOLS], sorted_weights[MAX_NUM_POOLS];
+    size_t first_page[MAX_NUM_POOLS + 1];
+    pool_t *pools_list = ctx->pools_list;
+    size_t page_shift = page_shift_for(ctx->heap_size, ctx->growable);
+
+    if (param_verif(block_sizes, weights, block_size_count, ctx->heap_size,
+                    page_shift) == false) {
+        return false;
+    }
+
+    // the size class tables need the pools in increasing block size, and
+    // blocks need sizes that keep them aligned
+    sort_pools(block_sizes, weights, block_size_count, sizes,
+               sorted_weights);
+    block_sizes = sizes;
+    split_pages(sorted_weights, block_size_count,
+                ctx->heap_size >> page_shift, first_page);
+
+    if (ctx->growable) {
+        // mapping the reserved range again unmaps and zeroes all of it
+        if (mmap(ctx->heap, ctx->heap_size, PROT_NONE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED,
+                 -1, 0) == MAP_FAILED) {
+            return false;
+        }
+    }
+    else if (ctx->num_pools != 0) {
+        // blocks that were never allocated are recognized by a NULL next
+        // pointer, so a heap used by an earlier layout is cleared first
+        memset(ctx->heap, 0, ctx->heap_size);
+    }
+    ctx->num_pools = 0;
+    ctx->use_spans = false;
+    ctx->eager = eager;
+    ctx->page_shift = page_shift;
+    memset(ctx->page_pool, NO_POOL, sizeof(ctx->page_pool));
+    page_size = (size_t) 1 << page_shift;
+
+    for (size_t i = 0; i < block_size_count; i++) {
+        index = first_page[i] << page_shift;
+        max_pool_size = (first_page[i+1] - first_page[i]) << page_shift;
+        memset(&ctx->page_pool[first_page[i]], i,
+               first_page[i+1] - first_page[i]);
+
+        pools_list[i].pool_block_size = block_sizes[i];
+        pools_list[i].pool_recip = recip(block_sizes[i]);
+
+        // address of the first block of the pool
+        pools_list[i].pool_start = (block_t *) &(ctx->heap[index]);
+        pools_list[i].pool_head = index;
+
+        // a growable pool starts with at least GROW_MIN_SIZE bytes mapped
+        mapped = max_pool_size;
+        if (ctx->growable) {
+            mapped = block_sizes[i] > GROW_MIN_SIZE ?
+                block_sizes[i] : GROW_MIN_SIZE;
+            mapped = (mapped + page_size - 1) / page_size * page_size;
+            if (mapped > max_pool_size) {
+                mapped = max_pool_size;
+            }
+            if (mprotect(&ctx->heap[index], mapped,
+                         PROT_READ | PROT_WRITE) != 0) {
+                return false;
+            }
+        }
+        pools_list[i].pool_reserved = max_pool_size;
+        pools_list[i].pool_mapped = mapped;
+        pools_list[i].pool_taken = 0;
+        pools_list[i].pool_drawn_peak = 0;
+        pools_list[i].pool_carved = 0;
+
+        // number of blocks of that size that fit in the mapped part
+        block_count = mapped/(block_sizes[i]);
+        // number of unused bytes of space in a pool
+        space_wastage = mapped - (block_count * block_sizes[i]);
+        // index of the last block of the pool
+        end_index = index + mapped - block_sizes[i] - space_wastage;
+
+        // address of the last block of the pool
+        pools_list[i].pool_end = (block_t *) &(ctx->heap[end_index]);
+
+        if (eager) {
+            thread_blocks(pools_list[i].pool_start, pools_list[i].pool_end,
+                          block_sizes[i]);
+            pools_list[i].pool_carved = block_count;
+        }
+
+        // blocks moved between a thread cache and the pool at a time,
+        // small enough that one thread can't hoard a small pool
+        pools_list[i].pool_batch = max_pool_size/(block_sizes[i])/8;
+        if (pools_list[i].pool_batch < 1) {
+            pools_list[i].pool_batch = 1;
+        }
+        if (pools_list[i].pool_batch > TCACHE_MAX_BATCH) {
+            pools_list[i].pool_batch = TCACHE_MAX_BATCH;
+        }
+    }
+    ctx->num_pools = block_size_count;
+    ctx->epoch++;
+    build_class_tables(ctx, block_sizes, block_size_count);
+    publish_fast(ctx);
+    trace_init(ctx, block_sizes, sorted_weights, block_size_count);
+    return true;
+}
+
+/* @brief Initializes the pools of an allocator context, giving each
+ * pool a share of the heap in proportion to its weight, see init_pools
+ *
+ * param[in] ctx: the allocator context
+ * param[in] block_sizes: A list containing the payload sizes
+ * of the blocks in each respective pool
+ * param[in] weights: A list containing the share of the heap given to
+ * each respective pool, NULL to share it equally
+ * param[in] block_sizes_count: Number of differently sized blocks possible
+ *
+ * returns true if initialization is succesful
+ * else returns false
+*/
+
+bool pool_ctx_init_weighted(pool_ctx_t *ctx, const size_t *block_sizes,
+                            const size_t *weights, size_t block_size_count)
+{
+    return init_pools(ctx, block_sizes, weights, block_size_count, false);
+}
+
+/* @brief Initializes the pools of an allocator context like
+ * pool_ctx_init_weighted, but threads the free list of every pool
+ * through all of its blocks and faults its pages in up front
+ *
+ * Taking blocks then only follows next pointers, with no check for
+ * blocks that were never allocated and no page faults, so allocations
+ * take the same time from the first one on. A growable context threads
+ * the memory it maps as it grows the same way. Since no block is known
+ * to be untouched any more, pool_get_stats counts all of them as carved
+ * and calloc zeroes every block it hands out.
+ *
+ * param[in] ctx: the allocator context
+ * param[in] block_sizes: A list containing the payload sizes
+ * of the blocks in each respective pool
+ * param[in] weights: A list containing the share of the heap given to
+ * each respective pool, NULL to share it equally
+ * param[in] block_sizes_count: Number of differently sized blocks possible
+ *
+ * returns true if initialization is succesful
+ * else returns false
+*/
+
+bool pool_ctx_init_eager(pool_ctx_t *ctx, const size_t *block_sizes,
+                         const size_t *weights, size_t block_size_count)
+{
+    return init_pools(ctx, block_sizes, weights, block_size_count, true);
+}
+
+/* @brief Initializes the pools of an allocator context with an equal
+ * share of the heap each
+ *
+ * param[in] ctx: the allocator context
+ * param[in] block_sizes: A list containing the payload sizes
+ * of the blocks in each respective pool
+ * param[in] block_sizes_count: Number of differently sized blocks possible
+ *
+ * returns true if initialization is succesful
+ * else returns false
+*/
+
+bool pool_ctx_init(pool_ctx_t *ctx, const size_t *block_sizes,
+                   size_t block_size_count)
+{
+    return pool_ctx_init_weighted(ctx, block_sizes, NULL, block_size_count);
+}
+
+/* @brief Initializes the pools of an allocator context so that they
+ * are made of spans handed out on demand instead of fixed shares of
+ * the heap
+ *
+ * The heap is split into spans of at least 2^SPAN_MIN_SHIFT bytes, large
+ * enough for the largest block. A pool takes an unused span whenever all
+ * of its spans are full, and a span whose blocks are all free again goes
+ * back to the unused spans for any pool to take. Taking and giving back
+ * blocks goes through the context's lock, which the thread caches of
+ * the global context only take once per batch.
+ *
+ * param[in] ctx: the allocator context
+ * param[in] block_sizes: A list containing the payload sizes
+ * of the blocks in each respective pool
+ * param[in] block_sizes_count: Number of differently sized blocks possible
+ *
+ * returns true if initialization is succesful
+ * else returns false
+*/
+
+bool pool_ctx_init_spans(pool_ctx_t *ctx, const size_t *block_sizes,
+                         size_t block_size_count)
+{
+    size_t sizes[MAX_NUM_POOLS], unused[MAX_NUM_POOLS];
+    size_t span_shift, span_blocks;
+    pool_t *pools_list = ctx->pools_list;
+
+    if (block_sizes == NULL || block_size_count > MAX_NUM_POOLS) {
+        return false;
+    }
+    sort_pools(block_sizes, NULL, block_size_count, sizes, unused);
+    span_shift = span_shift_for(sizes, block_size_count, ctx->heap_size,
+                                ctx->growable);
+    if (span_shift == 0) {
+        return false;
+    }
+    if (ctx->spans == NULL) {
+        ctx->spans = malloc(MAP_PAGES * sizeof(span_t));
+        if (ctx->spans == NULL) {
+            return false;
+        }
+    }
+    if (ctx->growable) {
+        if (mmap(ctx->heap, ctx->heap_size, PROT_NONE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED,
+                 -1, 0) == MAP_FAILED) {
+            return false;
+        }
+    }
+    else if (ctx->num_pools != 0) {
+        // spans that were never used are known to be zero
+        memset(ctx->heap, 0, ctx->heap_size);
+    }
+    ctx->num_pools = 0;
+    ctx->use_spans = true;
+    ctx->eager = false;
+    ctx->page_shift = span_shift;
+    memset(ctx->page_pool, NO_POOL, sizeof(ctx->page_pool));
+    ctx->num_spans = ctx->heap_size >> span_shift;
+    ctx->free_spans = NO_SPAN;
+    ctx->span_frontier = 0;
+
+    for (size_t i = 0; i < block_size_count; i++) {
+        span_blocks = ((size_t) 1 << span_shift)/sizes[i];
+
+        pools_list[i].pool_block_size = sizes[i];
+        pools_list[i].pool_recip = recip(sizes[i]);
+        pools_list[i].pool_partial = NO_SPAN;
+        pools_list[i].pool_start = (block_t *) ctx->heap;
+        pools_list[i].pool_head = 0;
+        pools_list[i].pool_end = (block_t *) ctx->heap;
+        pools_list[i].pool_reserved = 0;
+        pools_list[i].pool_mapped = 0;
+        pools_list[i].pool_taken = 0;
+        pools_list[i].pool_drawn_peak = 0;
+        pools_list[i].pool_carved = 0;
+
+        // a batch of a quarter span keeps a thread cache from pinning
+        // many spans of a pool
+        pools_list[i].pool_batch = span_blocks/4;
+        if (pools_list[i].pool_batch < 1) {
+            pools_list[i].pool_batch = 1;
+        }
+        if (pools_list[i].pool_batch > TCACHE_MAX_BATCH) {
+            pools_list[i].pool_batch = TCACHE_MAX_BATCH;
+        }
+    }
+    ctx->num_pools = block_size_count;
+    ctx->epoch++;
+
+    build_class_tables(ctx, sizes, block_size_count);
+    publish_fast(ctx);
+    trace_init(ctx, sizes, NULL, block_size_count);
+    return true;
+}
+
+/* @brief reserves a range of address space for a growable heap
+ * without mapping any of it
+ *
+ * param[in] heap_size: size in bytes of the range
+ *
+ * returns the start of the range or NULL
+*/
+
+static uint8_t *heap_reserve(size_t heap_size)
+{
+    if (heap_size == 0 || heap_size > UINT32_MAX) {
+        return NULL;
+    }
+
+    void *heap = mmap(NULL, heap_size, PROT_NONE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return heap == MAP_FAILED ? NULL : (uint8_t *) heap;
+}
+
+/* @brief moves the global pools back onto g_pool_heap if
+ * pool_init_growable moved them to a growable heap
+*/
+
+static void use_static_heap(void)
+{
+    if (!g_pool_ctx.growable) {
+        return;
+    }
+    munmap(g_pool_ctx.heap, g_pool_ctx.heap_size);
+    g_pool_ctx.heap = g_pool_heap;
+    g_pool_ctx.heap_size = HEAP_SIZE;
+    g_pool_ctx.growable = false;
+    g_pool_ctx.num_pools = 0;
+    // blocks cached for the growable heap point into unmapped memory
+    g_pool_ctx.epoch++;
+    publish_fast(&g_pool_ctx);
+    // still holds whatever the pools before the growable heap left
+    memset(g_pool_heap, 0, sizeof(g_pool_heap));
+}
+
+/* @brief Initializes the pools on g_pool_heap based on input parameters
+ *
+ * param[in] block_sizes: A list containing the payload sizes
+ * of the blocks in each respective pool
+ * param[in] block_sizes_count: Number of differently sized blocks possible
+ *
+ * returns true if initialization is succesful
+ * else returns false
+*/
+
+bool pool_init(const size_t *block_sizes, size_t block_size_count)
+{
+    return pool_init_weighted(block_sizes, NULL, block_size_count);
+}
+
+/* @brief Initializes the pools on g_pool_heap, giving each pool a
+ * share of the heap in proportion to its weight instead of an equal one
+ *
+ * param[in] block_sizes: A list containing the payload sizes
+ * of the blocks in each respective pool
+ * param[in] weights: A list containing the share of the heap given to
+ * each respective pool, NULL to share it equally
+ * param[in] block_sizes_count: Number of differently sized blocks possible
+ *
+ * returns true if initialization is succesful
+ * else returns false
+*/
+
+bool pool_init_weighted(const size_t *block_sizes, const size_t *weights,
+                        size_t block_size_count)
+{
+    if (param_verif(block_sizes, weights, block_size_count, HEAP_SIZE,
+                    page_shift_for(HEAP_SIZE, false)) == false) {
+        return false;
+    }
+    use_static_heap();
+    return pool_ctx_init_weighted(&g_pool_ctx, block_sizes, weights,
+                                  block_size_count);
+}
+
+/* @brief Initializes the pools on g_pool_heap like pool_init_weighted,
+ * but with their free lists threaded and their pages faulted in up
+ * front, see pool_ctx_init_eager
+ *
+ * param[in] block_sizes: A list containing the payload sizes
+ * of the blocks in each respective pool
+ * param[in] weights: A list containing the share of the heap given to
+ * each respective pool, NULL to share it equally
+ * param[in] block_sizes_count: Number of differently sized blocks possible
+ *
+ * returns true if initialization is succesful
+ * else returns false
+*/
+
+bool pool_init_eager(const size_t *block_sizes, const size_t *weights,
+                     size_t block_size_count)
+{
+    if (param_verif(block_sizes, weights, block_size_count, HEAP_SIZE,
+                    page_shift_for(HEAP_SIZE, false)) == false) {
+        return false;
+    }
+    use_static_heap();
+    return pool_ctx_init_eager(&g_pool_ctx, block_sizes, weights,
+                               block_size_count);
+}
+
+/* @brief Initializes the pools on g_pool_heap so that they are made
+ * of spans handed out on demand, see pool_ctx_init_spans
+ *
+ * param[in] block_sizes: A list containing the payload sizes
+ * of the blocks in each respective pool
+ * param[in] block_sizes_count: Number of differently sized blocks possible
+ *
+ * returns true if initialization is succesful
+ * else returns false
+*/
+
+bool pool_init_spans(const size_t *block_sizes, size_t block_size_count)
+{
+    size_t sizes[MAX_NUM_POOLS], unused[MAX_NUM_POOLS];
+
+    if (block_sizes == NULL || block_size_count > MAX_NUM_POOLS) {
+        return false;
+    }
+    sort_pools(block_sizes, NULL, block_size_count, sizes, unused);
+    if (span_shift_for(sizes, block_size_count, HEAP_SIZE, false) == 0) {
+        return false;
+    }
+    use_static_heap();
+    return pool_ctx_init_spans(&g_pool_ctx, block_sizes, block_size_count);
+}
+
+/* @brief Computes jemalloc style block sizes: starting at min, the
+ * block sizes grow in steps of a spacing'th of the power of two below
+ * them, so there are spacing block sizes per doubling
+ *
+ * Steps are multiples of 8 and at least 8 bytes, and the last block
+ * size is max rounded up to a multiple of 8.
+ *
+ * param[in] min: the smallest block size
+ * param[in] max: the largest block size
+ * param[in] spacing: the number of block sizes per doubling
+ * param[out] block_sizes: the block sizes, room for MAX_NUM_POOLS
+ *
+ * returns the number of block sizes, or 0 if the parameters are invalid
+ * or would need more than MAX_NUM_POOLS block sizes
+*/
+
+size_t pool_geometric_sizes(size_t min, size_t max, size_t spacing,
+                            size_t *block_sizes)
+{
+    size_t count = 0, size, step;
+
+    if (min == 0 || max < min || spacing == 0 || block_sizes == NULL) {
+        return 0;
+    }
+
+    max = (max + 7) & ~(size_t) 7;
+    size = (min + 7) & ~(size_t) 7;
+    while (size < max) {
+        if (count == MAX_NUM_POOLS) {
+            return 0;
+        }
+        block_sizes[count++] = size;
+
+        // the power of two at or below size, divided into spacing steps
+        step = ((size_t) 1 << (63 - __builtin_clzll(size)))/spacing;
+        step = step < 8 ? 8 : step & ~(size_t) 7;
+        size += step;
+    }
+    if (count == MAX_NUM_POOLS) {
+        return 0;
+    }
+    block_sizes[count++] = max;
+    return count;
+}
+
+/* @brief Initializes the pools on g_pool_heap with the block sizes
+ * computed by pool_geometric_sizes
+ *
+ * param[in] min: the smallest block size
+ * param[in] max: the largest block size
+ * param[in] spacing: the number of block sizes per doubling
+ *
+ * returns true if initialization is succesful
+ * else returns false
+*/
+
+bool pool_init_geometric(size_t min, size_t max, size_t spacing)
+{
+    size_t block_sizes[MAX_NUM_POOLS];
+    size_t block_size_count = pool_geometric_sizes(min, max, spacing,
+                                                   block_sizes);
+
+    return block_size_count != 0 &&
+        pool_init(block_sizes, block_size_count);
+}
+
+/* @brief Initializes the global pools on a growable heap instead
+ * of g_pool_heap
+ *
+ * reserve_size bytes of address space are reserved and split between
+ * the pools like pool_init splits g_pool_heap, but a pool only maps
+ * memory for its blocks as it runs out, doubling each time.
+ *
+ * param[in] block_sizes: A list containing the payload sizes
+ * of the blocks in each respective pool
+ * param[in] block_sizes_count: Number of differently sized blocks possible
+ * param[in] reserve_size: size in bytes of the address space to
+ * reserve, at most 4 GB since blocks are named by 32 bit offsets
+ *
+ * returns true if initialization is succesful
+ * else returns false
+*/
+
+bool pool_init_growable(const size_t *block_sizes, size_t block_size_count,
+                        size_t reserve_size)
+{
+    if (param_verif(block_sizes, NULL, block_size_count, reserve_size,
+                    page_shift_for(reserve_size, true)) == false) {
+        return false;
+    }
+
+    uint8_t *heap = heap_reserve(reserve_size);
+    if (heap == NULL) {
+        return false;
+    }
+    use_static_heap();
+    g_pool_ctx.heap = heap;
+    g_pool_ctx.heap_size = reserve_size;
+    g_pool_ctx.growable = true;
+
+    if (!pool_ctx_init(&g_pool_ctx, block_sizes, block_size_count)) {
+        use_static_heap();
+        return false;
+    }
+    return true;
+}
+
+/* @brief Creates an allocator context with a heap of its own
+ *
+ * The heap is mapped zeroed, page aligned and untouched, so its pages
+ * are placed on the NUMA node of the thread that first allocates from
+ * them.
+ *
+ * param[in] block_sizes: A list containing the payload sizes
+ * of the blocks in each respective pool
+ * param[in] block_sizes_count: Number of differently sized blocks possible
+ * param[in] heap_size: size in bytes of the heap, at most 4 GB since
+ * blocks are named by 32 bit offsets into it
+ *
+ * returns the context, or NULL if the parameters are invalid or the
+ * memory for it can't be allocated
+*/
+
+pool_ctx_t *pool_create(const size_t *block_sizes, size_t block_size_count,
+                        size_t heap_size)
+{
+    if (heap_size == 0 || heap_size > UINT32_MAX) {
+        return NULL;
+    }
+
+    pool_ctx_t *ctx = calloc(1, sizeof(pool_ctx_t));
+    if (ctx == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&ctx->lock, NULL);
+    ctx->heap = mmap(NULL, heap_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ctx->heap == MAP_FAILED) {
+        ctx->heap = NULL;
+    }
+    ctx->heap_size = heap_size;
+
+    if (ctx->heap == NULL ||
+        !pool_ctx_init(ctx, block_sizes, block_size_count)) {
+        pool_destroy(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+/* @brief Creates an allocator context on a growable heap
+ *
+ * Like pool_init_growable, reserve_size bytes of address space are
+ * split between the pools and mapped as the pools run out.
+ *
+ * param[in] block_sizes: A list containing the payload sizes
+ * of the blocks in each respective pool
+ * param[in] block_sizes_count: Number of differently sized blocks possible
+ * param[in] reserve_size: size in bytes of the address space to
+ * reserve, at most 4 GB since blocks are named by 32 bit offsets
+ *
+ * returns the context, or NULL if the parameters are invalid or the
+ * address space can't be reserved
+*/
+
+pool_ctx_t *pool_create_growable(const size_t *block_sizes,
+                                 size_t block_size_count,
+                                 size_t reserve_size)
+{
+    uint8_t *heap = heap_reserve(reserve_size);
+    if (heap == NULL) {
+        return NULL;
+    }
+
+    pool_ctx_t *ctx = calloc(1, sizeof(pool_ctx_t));
+    if (ctx == NULL) {
+        munmap(heap, reserve_size);
+        return NULL;
+    }
+    pthread_mutex_init(&ctx->lock, NULL);
+    ctx->heap = heap;
+    ctx->heap_size = reserve_size;
+    ctx->growable = true;
+
+    if (!pool_ctx_init(ctx, block_sizes, block_size_count)) {
+        pool_destroy(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+/* @brief Releases an allocator context and its heap. Every block
+ * allocated from it becomes invalid
+ *
+ * param[in] ctx: the allocator context, may be NULL
+*/
+
+void pool_destroy(pool_ctx_t *ctx)
+{
+    if (ctx == NULL) {
+        return;
+    }
+    if (ctx->heap != NULL) {
+        munmap(ctx->heap, ctx->heap_size);
+    }
+    pthread_mutex_destroy(&ctx->lock);
+    free(ctx->spans);
+    free(ctx);
+}
+
+/* @brief allocates an object of size n on the heap of an allocator
+ * context if n is less than or equal to the size of blocks in a
+ * certain pool and the pool has space. Else fails
+ *
+ * Contexts are meant to be owned by one worker, so the block is taken
+ * straight from the lock-free pool without going through a thread cache.
+ *
+ * param[in] ctx: the allocator context
+ * param[in] n: size of the object that is to be allocated
+ *
+ * returns the address of the allocated memory or NULL
+ *
+ * Time Complexity: O(1)
+*/
+
+void *pool_ctx_malloc(pool_ctx_t *ctx, size_t n)
+{
+    if (n < 1) {
+        return NULL;
+    }
+    return ctx_alloc(ctx, n, 1, NULL);
+}
+
+/* @brief allocates an object of size n aligned to alignment bytes from
+ * an allocator context, like pool_memalign
+ *
+ * param[in] ctx: the allocator context
+ * param[in] alignment: a power of two up to MAX_ALIGN
+ * param[in] n: size of the object that is to be allocated
+ *
+ * returns the address of the allocated memory or NULL
+*/
+
+void *pool_ctx_memalign(pool_ctx_t *ctx, size_t alignment, size_t n)
+{
+    if (n < 1 || !valid_align(alignment)) {
+        return NULL;
+    }
+    return ctx_alloc(ctx, n, alignment, NULL);
+}
+
+/* @brief frees an object allocated by pool_ctx_malloc so that
+ * the memory can be re-used
+ *
+ * param[in] ctx: the allocator context the object was allocated from
+ * param[in] ptr: the address to allocated memory to be freed
+ *
+ * Time Complexity: O(1)
+*/
+
+void pool_ctx_free(pool_ctx_t *ctx, void *ptr)
+{
+    block_t *block = (block_t *) ptr;
+    size_t i = find_pool(ctx, block);
+
+    if (i < ctx->num_pools) {
+        add_to_pool(ctx, i, block, block);
+    }
+}
+
+/* @brief frees an object of size n allocated by pool_ctx_malloc,
+ * like pool_free_sized
+ *
+ * param[in] ctx: the allocator context the object was allocated from
+ * param[in] ptr: the address to allocated memory to be freed
+ * param[in] n: the size the object was allocated with
+ *
+ * Time Complexity: O(1)
+*/
+
+void pool_ctx_free_sized(pool_ctx_t *ctx, void *ptr, size_t n)
+{
+    block_t *block = (block_t *) ptr;
+    size_t i = size_class(ctx, n);
+
+    debug_check_sized(ctx, block, n);
+    if (i < ctx->num_pools && in_pool(ctx, i, block)) {
+        add_to_pool(ctx, i, block, block);
+    }
+    else {
+        pool_ctx_free(ctx, ptr);
+    }
+}
+
+/* @brief allocates a zeroed array from an allocator context, like
+ * pool_calloc
+ *
+ * param[in] ctx: the allocator context
+ * param[in] nmemb: the number of objects
+ * param[in] size: size of each object
+ *
+ * returns the address of the allocated memory or NULL
+*/
+
+void *pool_ctx_calloc(pool_ctx_t *ctx, size_t nmemb, size_t size)
+{
+    size_t n;
+    bool zeroed = false;
+
+    if (__builtin_mul_overflow(nmemb, size, &n) || n < 1) {
+        return NULL;
+    }
+
+    void *ptr = ctx_alloc(ctx, n, 1, &zeroed);
+    if (ptr != NULL) {
+        memset(ptr, 0, zeroed ? sizeof(block_t) : n);
+    }
+    return ptr;
+}
+
+/* @brief resizes an object allocated from an allocator context, like
+ * pool_realloc
+ *
+ * param[in] ctx: the allocator context the object was allocated from
+ * param[in] ptr: the address to allocated memory, NULL to allocate
+ * param[in] n: the new size of the object, 0 to free it
+ *
+ * returns the address of the resized object or NULL
+*/
+
+void *pool_ctx_realloc(pool_ctx_t *ctx, void *ptr, size_t n)
+{
+    if (ptr == NULL) {
+        return pool_ctx_malloc(ctx, n);
+    }
+
+    block_t *block = (block_t *) ptr;
+    size_t i = find_pool(ctx, block);
+
+    if (i == ctx->num_pools) {
+        return NULL;
+    }
+    if (n < 1) {
+        add_to_pool(ctx, i, block, block);
+        return NULL;
+    }
+
+    size_t size = ctx->pools_list[i].pool_block_size;
+    if (n <= size) {
+        return ptr;
+    }
+
+    void *moved = pool_ctx_malloc(ctx, n);
+    if (moved != NULL) {
+        memcpy(moved, ptr, size);
+        add_to_pool(ctx, i, block, block);
+    }
+    return moved;
+}
+
+/* @brief allocates an object of size n on the g_pool_heap if
+ * n is less than or equal to the size of blocks in a certain
+ * pool and the pool has space. Else fails
+ *
+ * The block is taken from the calling thread's cache, which is refilled
+ * from the shared pool when it is empty.
+ *
+ * param[in] n: size of the object that is to be allocated
+ *
+ * returns the address of the allocated memory or NULL
+ *
+ * Time Complexity: O(1)
+*/
+
+void *pool_malloc(size_t n)
+{
+    if (n < 1) {
+        return NULL;
+    }
+
+    void *ptr = tcache_alloc(n, 1, NULL);
+    trace_op(POOL_TRACE_MALLOC, n, ptr);
+    return ptr;
+}
+
+/* @brief allocates an object of size n on the g_pool_heap whose address
+ * is a multiple of alignment
+ *
+ * Blocks are aligned to the largest power of two their size is a
+ * multiple of, up to MAX_ALIGN, so the object comes from the first pool
+ * that fits n and whose blocks are aligned enough. A pool of 32 byte
+ * multiples, for example, serves 32 byte aligned objects.
+ *
+ * param[in] alignment: a power of two up to MAX_ALIGN
+ * param[in] n: size of the object that is to be allocated
+ *
+ * returns the address of the allocated memory, or NULL if alignment is
+ * invalid or no pool with blocks that fit n and are aligned enough has
+ * space
+ *
+ * Time Complexity: O(1)
+*/
+
+void *pool_memalign(size_t alignment, size_t n)
+{
+    if (n < 1 || !valid_align(alignment)) {
+        return NULL;
+    }
+
+    void *ptr = tcache_alloc(n, alignment, NULL);
+    trace_op(POOL_TRACE_MALLOC, n, ptr);
+    return ptr;
+}
+
+/* @brief allocates a zeroed array of nmemb objects of size size on the
+ * g_pool_heap
+ *
+ * Blocks that were never allocated before are already zero apart from
+ * their next pointer, so only that pointer is cleared for them instead
+ * of all n bytes.
+ *
+ * param[in] nmemb: the number of objects
+ * param[in] size: size of each object
+ *
+ * returns the address of the allocated memory, or NULL if the pools
+ * can't fit nmemb*size bytes or it overflows
+ *
+ * Time Complexity: O(1), plus O(n) to clear a block that was used before
+*/
+
+void *pool_calloc(size_t nmemb, size_t size)
+{
+    size_t n;
+    bool zeroed = false;
+
+    if (__builtin_mul_overflow(nmemb, size, &n) || n < 1) {
+        return NULL;
+    }
+
+    void *ptr = tcache_alloc(n, 1, &zeroed);
+    if (ptr != NULL) {
+        memset(ptr, 0, zeroed ? sizeof(block_t) : n);
+    }
+    trace_op(POOL_TRACE_MALLOC, n, ptr);
+    return ptr;
+}
+
+/* @brief resizes an object on the g_pool_heap to n bytes
+ *
+ * The object stays where it is if n still fits its block. Otherwise it
+ * is copied once to a block that fits n and its old block is freed.
+ *
+ * param[in] ptr: the address to allocated memory, NULL to allocate
+ * param[in] n: the new size of the object, 0 to free it
+ *
+ * returns the address of the resized object, or NULL if ptr isn't an
+ * allocated block, n is 0 or no pool can fit n. The object is left
+ * untouched when no pool can fit n
+*/
+
+void *pool_realloc(void *ptr, size_t n)
+{
+    if (ptr == NULL) {
+        return pool_malloc(n);
+    }
+
+    block_t *block = (block_t *) ptr;
+    size_t i = find_pool(&g_pool_ctx, block);
+
+    if (i == g_pool_ctx.num_pools) {
+        return NULL;
+    }
+    if (n < 1) {
+        trace_op(POOL_TRACE_FREE, 0, block);
+        tcache_put(i, block);
+        return NULL;
+    }
+
+    size_t size = g_pool_ctx.pools_list[i].pool_block_size;
+    trace_op(POOL_TRACE_REALLOC_FROM, 0, block);
+    if (n <= size) {
+        trace_op(POOL_TRACE_REALLOC, n, ptr);
+        return ptr;
+    }
+
+    void *moved = tcache_alloc(n, 1, NULL);
+    if (moved != NULL) {
+        memcpy(moved, ptr, size);
+        tcache_put(i, block);
+    }
+    // a failed move leaves the object where it was
+    trace_op(POOL_TRACE_REALLOC, n, moved != NULL ? moved : ptr);
+    return moved;
+}
+
+/* @brief frees an allocated object on the g_pool_heap so that
+ * the memory can be re-used
+ *
+ * The block goes to the calling thread's cache, which gives a batch
+ * back to the shared pool when it grows too large.
+ *
+ * param[in] ptr: the address to allocated memory to be freed
+ *
+ * Time Complexity: O(1)
+*/
+
+void pool_free(void *ptr)
+{
+    block_t *block = (block_t *) ptr;
+    size_t i = find_pool(&g_pool_ctx, block);
+
+    if (i == g_pool_ctx.num_pools) {
+        return;
+    }
+    trace_op(POOL_TRACE_FREE, 0, block);
+    tcache_put(i, block);
+}
+
+/* @brief frees an object of size n on the g_pool_heap, like pool_free
+ * but without looking up the pool of the object
+ *
+ * n is mapped to its pool with the size class tables, and a comparison
+ * against the pool's range confirms the object is in it. Objects that
+ * spilled into a pool of larger blocks fail that check and are freed
+ * with pool_free instead. When compiled with POOL_DEBUG, the object is
+ * also checked to be a block of a pool that fits n, aborting if not.
+ *
+ * param[in] ptr: the address to allocated memory to be freed
+ * param[in] n: the size the object was allocated with
+ *
+ * Time Complexity: O(1)
+*/
+
+void pool_free_sized(void *ptr, size_t n)
+{
+    block_t *block = (block_t *) ptr;
+    size_t i = size_class(&g_pool_ctx, n);
+
+    debug_check_sized(&g_pool_ctx, block, n);
+    if (i < g_pool_ctx.num_pools && in_pool(&g_pool_ctx, i, block)) {
+        trace_op(POOL_TRACE_FREE, n, block);
+        tcache_put(i, block);
+    }
+    else {
+        pool_free(ptr);
+    }
+}
+
+/* @brief checks whether an address lies in the heap of the global
+ * pools, whether or not it is the start of an allocated block
+ *
+ * param[in] ptr: the address
+ *
+ * returns true if ptr is in the heap
+*/
+
+bool pool_owns(const void *ptr)
+{
+    return (uintptr_t) ptr - (uintptr_t) g_pool_ctx.heap <
+        g_pool_ctx.heap_size;
+}
+
+/* @brief finds the number of bytes usable at an object on the
+ * g_pool_heap, which is the size of its block
+ *
+ * param[in] ptr: the address to allocated memory
+ *
+ * returns the size of the block, or 0 if ptr isn't the start of a block
+*/
+
+size_t pool_usable_size(const void *ptr)
+{
+    size_t i = find_pool(&g_pool_ctx, (block_t *) ptr);
+
+    return i == g_pool_ctx.num_pools ? 0 :
+        g_pool_ctx.pools_list[i].pool_block_size;
+}
+
+/* @brief gives every block cached by the calling thread back to the
+ * shared pools so that other threads can allocate them
+*/
+
+void pool_thread_cache_flush(void)
+{
+    tcache_drain(&pool_tcache);
+}
+
+/* @brief writes the records every thread traced so far to the trace
+ * file, when compiled with POOL_TRACE
+*/
+
+void pool_trace_flush(void)
+{
+#ifdef POOL_TRACE
+    pthread_mutex_lock(&trace_lock);
+    trace_drain();
+    pthread_mutex_unlock(&trace_lock);
+#endif
+}
+
+/* @brief sums up the counters of the global pools
+ *
+ * The counters of each thread are read without stopping it, so totals
+ * taken while other threads allocate are only approximately consistent
+ * with each other.
+ *
+ * param[out] stats: the counters, of every pool and of oversized requests
+*/
+
+void pool_get_stats(pool_stats_t *stats)
+{
+    pool_ctx_t *ctx = &g_pool_ctx;
+    size_t num_pools = ctx->num_pools;
+    uint64_t epoch = ctx->epoch;
+    tcache_t sum;
+
+    pthread_mutex_lock(&stats_lock);
+    memcpy(&sum, &retired, sizeof(sum));
+    for (tcache_t *tc = tcache_list; tc != NULL; tc = tc->next) {
+        // a cache that still has an older epoch counted for other pools
+        if (__atomic_load_n(&tc->epoch, __ATOMIC_ACQUIRE) == epoch) {
+            stats_sum(&sum, tc);
+        }
+    }
+    pthread_mutex_unlock(&stats_lock);
+
+    memset(stats, 0, sizeof(*stats));
+    stats->num_classes = num_pools;
+    stats->oversized = sum.oversized;
+    memcpy(stats->histogram, sum.histogram, sizeof(stats->histogram));
+
+    for (size_t i = 0; i < num_pools; i++) {
+        pool_class_stats_t *class = &stats->classes[i];
+        pool_t *pool = &ctx->pools_list[i];
+        size_t size = pool->pool_block_size;
+
+        class->block_size = size;
+        class->allocs = sum.bins[i].allocs;
+        class->frees = sum.bins[i].frees;
+        class->failed = sum.bins[i].failed;
+        class->spills = sum.bins[i].spills;
+        class->requested = sum.bins[i].requested;
+        class->wasted = class->allocs * size > class->requested ?
+            class->allocs * size - class->requested : 0;
+        // a block freed by another thread can be counted before the
+        // allocation that handed it out
+        class->live = class->allocs > class->frees ?
+            class->allocs - class->frees : 0;
+        class->drawn_peak = __atomic_load_n(&pool->pool_drawn_peak,
+                                            __ATOMIC_RELAXED);
+        class->carved = __atomic_load_n(&pool->pool_carved,
+                                        __ATOMIC_RELAXED);
+        if (ctx->use_spans) {
+            size_t unused = ctx->num_spans -
+                __atomic_load_n(&ctx->span_frontier, __ATOMIC_RELAXED);
+            class->untouched = unused * ((((size_t) 1) << ctx->page_shift) /
+                                         size);
+        }
+        else {
+            size_t capacity = pool->pool_reserved / size;
+            class->untouched = capacity > class->carved ?
+                capacity - class->carved : 0;
+        }
+    }
+}
+
+/* @brief prints the counters of the global pools, a line per pool and
+ * then the requested sizes mapped to each pool, to find block sizes that
+ * would waste less
+ *
+ * Buckets of the histogram above POOL_SMALL_SIZE_MAX span several sizes,
+ * they are listed under the pool their largest size maps to.
+ *
+ * param[in] out: the stream to print to
+*/
+
+void pool_dump_stats(FILE *out)
+{
+    pool_stats_t stats;
+
+    pool_get_stats(&stats);
+
+    fprintf(out, "%4s %10s %12s %12s %12s %14s %14s %7s\n", "pool",
+            "block", "allocs", "live", "drawn", "requested", "wasted",
+            "waste%");
+    for (size_t i = 0; i < stats.num_classes; i++) {
+        pool_class_stats_t *class = &stats.classes[i];
+        uint64_t delivered = class->requested + class->wasted;
+
+        fprintf(out, "%4zu %10zu %12llu %12llu %12llu %14llu %14llu %7.1f\n",
+                i, class->block_size, (unsigned long long) class->allocs,
+                (unsigned long long) class->live,
+                (unsigned long long) class->drawn_peak,
+                (unsigned long long) class->requested,
+                (unsigned long long) class->wasted,
+                delivered != 0 ? 100.0 * class->wasted / delivered : 0.0);
+    }
+    fprintf(out, "oversized requests: %llu\n",
+            (unsigned long long) stats.oversized);
+
+    for (size_t i = 0; i <= stats.num_classes; i++) {
+        bool header = false;
+
+        for (size_t b = 0; b < POOL_HIST_BUCKETS; b++) {
+            size_t size = pool_hist_bucket_size(b);
+            if (stats.histogram[b] == 0 ||
+                size_class(&g_pool_ctx, size) != i) {
+                continue;
+            }
+            if (!header) {
+                if (i < stats.num_classes) {
+                    fprintf(out, "requests mapped to pool %zu (%zu bytes):\n",
+                            i, stats.classes[i].block_size);
+                }
+                else {
+                    fprintf(out, "requests larger than every block:\n");
+                }
+                header = true;
+            }
+            fprintf(out, "    <= %10zu bytes: %12llu\n", size,
+                    (unsigned long long) stats.histogram[b]);
+        }
+    }
+}
+
+/* @brief the bytes wasted by serving candidates i to j of pool_tune
+ * with blocks the size of candidate j
+ *
+ * param[in] sizes: the candidate sizes
+ * param[in] count_sum: the requests of the candidates before each one
+ * param[in] byte_sum: the bytes requested by the candidates before each one
+*/
+
+static inline __uint128_t tune_waste(const size_t *sizes,
+                                     const __uint128_t *count_sum,
+                                     const __uint128_t *byte_sum, size_t i,
+                                     size_t j)
+{
+    return (count_sum[j+1] - count_sum[i]) * sizes[j] -
+        (byte_sum[j+1] - byte_sum[i]);
+}
+
+/* @brief computes the block sizes that waste the fewest bytes on the
+ * requests of a histogram, and weights that split a heap between them
+ *
+ * Every non-empty bucket of the histogram is a candidate block size, and
+ * its requests are taken to be as large as the bucket's largest size,
+ * which is exact up to POOL_SMALL_SIZE_MAX. The waste of a choice of
+ * block sizes is the bytes lost rounding each request up to the block
+ * size that fits it, and the choice with the least waste for k block
+ * sizes is found with dynamic programming: waste[k][j] is the least waste
+ * of the requests up to candidate j with k block sizes, the largest of
+ * which is candidate j.
+ *
+ * Each pool then gets the pages of the heap it needs for one block, and
+ * the rest in proportion to the bytes its requests took, since the
+ * histogram counts requests but not how long they live. Fewer block
+ * sizes are used if the heap is too small to give each its block.
+ *
+ * param[in] histogram: requests by size, see pool_hist_bucket
+ * param[in] max_classes: the most block sizes to use, up to 64
+ * param[in] heap_size: size in bytes of the heap the pools will split
+ * param[out] block_sizes: the block sizes, sorted
+ * param[out] weights: the pages of the heap each pool gets
+ *
+ * returns the number of block sizes, 0 if the histogram is empty or no
+ * request fits the heap
+ *
+ * Time Complexity: O(max_classes * POOL_HIST_BUCKETS^2)
+*/
+
+size_t pool_tune(const uint64_t *histogram, size_t max_classes,
+                 size_t heap_size, size_t *block_sizes, size_t *weights)
+{
+    size_t sizes[POOL_HIST_BUCKETS];
+    uint64_t counts[POOL_HIST_BUCKETS];
+    __uint128_t count_sum[POOL_HIST_BUCKETS + 1];
+    __uint128_t byte_sum[POOL_HIST_BUCKETS + 1];
+    __uint128_t waste[2][POOL_HIST_BUCKETS];
+    uint8_t last[MAX_NUM_POOLS][POOL_HIST_BUCKETS];
+    size_t m = 0, max_k, page_shift, heap_pages;
+
+    if (histogram == NULL || block_sizes == NULL || weights == NULL ||
+        max_classes == 0) {
+        return 0;
+    }
+    page_shift = page_shift_for(heap_size, false);
+    heap_pages = heap_size >> page_shift;
+
+    // requests of 0 bytes get no block, and those larger than the heap
+    // can't be served by any layout
+    for (size_t b = 1; b < POOL_HIST_BUCKETS; b++) {
+        size_t size = pool_hist_bucket_size(b);
+        if (histogram[b] != 0 && size <= heap_size) {
+            sizes[m] = size;
+            counts[m++] = histogram[b];
+        }
+    }
+    if (m == 0 || heap_pages == 0) {
+        return 0;
+    }
+
+    count_sum[0] = byte_sum[0] = 0;
+    for (size_t j = 0; j < m; j++) {
+        count_sum[j+1] = count_sum[j] + counts[j];
+        byte_sum[j+1] = byte_sum[j] + (__uint128_t) counts[j] * sizes[j];
+    }
+
+    max_k = max_classes < m ? max_classes : m;
+    if (max_k > MAX_NUM_POOLS) {
+        max_k = MAX_NUM_POOLS;
+    }
+    for (size_t j = 0; j < m; j++) {
+        waste[0][j] = tune_waste(sizes, count_sum, byte_sum, 0, j);
+    }
+    for (size_t k = 1; k < max_k; k++) {
+        __uint128_t *prev = waste[(k-1) & 1], *cur = waste[k & 1];
+
+        for (size_t j = k; j < m; j++) {
+            cur[j] = prev[k-1] + tune_waste(sizes, count_sum, byte_sum, k, j);
+            last[k][j] = k - 1;
+            for (size_t i = k; i < j; i++) {
+                __uint128_t cost = prev[i] +
+                    tune_waste(sizes, count_sum, byte_sum, i+1, j);
+                if (cost < cur[j]) {
+                    cur[j] = cost;
+                    last[k][j] = i;
+                }
+            }
+        }
+    }
+
+    for (size_t k = max_k; k >= 1; k--) {
+        size_t chosen[MAX_NUM_POOLS], min_pages = 0, spare, largest = 0;
+        __uint128_t demand[MAX_NUM_POOLS], total = 0;
+
+        // walks back from the largest candidate, which every layout needs
+        chosen[k-1] = m - 1;
+        for (size_t c = k - 1; c > 0; c--) {
+            chosen[c-1] = last[c][chosen[c]];
+        }
+
+        for (size_t c = 0; c < k; c++) {
+            size_t first = c == 0 ? 0 : chosen[c-1] + 1;
+            size_t size = sizes[chosen[c]];
+
+            block_sizes[c] = size;
+            weights[c] = (size + ((size_t) 1 << page_shift) - 1) >> page_shift;
+            min_pages += weights[c];
+            demand[c] = (count_sum[chosen[c]+1] - count_sum[first]) * size;
+            total += demand[c];
+            if (demand[c] > demand[largest]) {
+                largest = c;
+            }
+        }
+        if (min_pages > heap_pages) {
+            continue;
+        }
+
+        spare = heap_pages - min_pages;
+        for (size_t c = 0; c < k; c++) {
+            size_t extra = (size_t) (spare * demand[c] / total);
+            weights[c] += extra;
+            min_pages += extra;
+        }
+        // pages lost to rounding down go to the busiest pool
+        weights[largest] += heap_pages - min_pages;
+        return k;
+    }
+    return 0;
+}
+
+/* @brief allocates count objects of size n on the g_pool_heap
+ *
+ * The calling thread's cache is used up first and the rest is taken off
+ * the shared pools as one chain per pool, so the size class is looked up
+ * once and the pools are updated once for the whole batch. When a pool
+ * runs out the batch spills into the pools of larger blocks.
+ *
+ * param[in] n: size of the objects that are to be allocated
+ * param[out] out: the addresses of the allocated memory
+ * param[in] count: the number of objects
+ *
+ * returns the number of objects allocated into out[0] onwards
+ *
+ * Time Complexity: O(count)
+*/
+
+size_t pool_malloc_batch(size_t n, void **out, size_t count)
+{
+    size_t filled = malloc_batch(&g_pool_ctx, tcache_get(), n, out, count);
+
+    for (size_t k = 0; k < filled; k++) {
+        trace_op(POOL_TRACE_MALLOC, n, out[k]);
+    }
+    return filled;
+}
+
+/* @brief frees count objects on the g_pool_heap
+ *
+ * The objects go straight back to the shared pools, one chain per run of
+ * objects from the same pool, without filling the calling thread's cache.
+ *
+ * param[in] ptrs: the addresses of the objects, invalid ones are skipped
+ * param[in] count: the number of addresses
+ *
+ * returns the number of objects freed
+ *
+ * Time Complexity: O(count)
+*/
+
+size_t pool_free_batch(void **ptrs, size_t count)
+{
+    for (size_t k = 0; k < count; k++) {
+        trace_op(POOL_TRACE_FREE, 0, ptrs[k]);
+    }
+    return free_batch(&g_pool_ctx, tcache_get(), ptrs, count);
+}
+
+/* @brief allocates count objects of size n from an allocator context,
+ * like pool_malloc_batch
+ *
+ * param[in] ctx: the allocator context
+ * param[in] n: size of the objects that are to be allocated
+ * param[out] out: the addresses of the allocated memory
+ * param[in] count: the number of objects
+ *
+ * returns the number of objects allocated into out[0] onwards
+*/
+
+size_t pool_ctx_malloc_batch(pool_ctx_t *ctx, size_t n, void **out,
+                             size_t count)
+{
+    return malloc_batch(ctx, NULL, n, out, count);
+}
+
+/* @brief frees count objects allocated from an allocator context,
+ * like pool_free_batch
+ *
+ * param[in] ctx: the allocator context the objects were allocated from
+ * param[in] ptrs: the addresses of the objects, invalid ones are skipped
+ * param[in] count: the number of addresses
+ *
+ * returns the number of objects freed
+*/
+
+size_t pool_ctx_free_batch(pool_ctx_t *ctx, void **ptrs, size_t count)
+{
+    return free_batch(ctx, NULL, ptrs, count);
+}
@@ -4,6 +4,27 @@
  *
 */
 
+#ifndef POOL_ALLOC_H
+#define POOL_ALLOC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The most pools, i.e block sizes, an allocator can have, and the largest
+// size whose pool is found with a single table load.
+#define POOL_MAX_NUM_POOLS 64
+#define POOL_SMALL_SIZE_MAX 1024
+
+// The number of buckets of the histogram of requested sizes: one per 8
+// bytes up to POOL_SMALL_SIZE_MAX, then four per doubling up to 4 GB.
+#define POOL_HIST_BUCKETS (POOL_SMALL_SIZE_MAX/8 + 1 + 4*22)
+
 // Initialize the pool allocator with a set of block sizes appropriate
 // for this application.
 // Returns true on success, false on failure.
@@ -15,3 +36,253 @@ void* pool_malloc(size_t n);
 
 // Release allocation pointed to by ptr.
 void pool_free(void* ptr);
+
+// Allocate a zeroed array of nmemb objects of size bytes each.
+// Returns pointer to allocate memory on success, NULL on failure.
+void* pool_calloc(size_t nmemb, size_t size);
+
+// Resize the allocation pointed to by ptr to n bytes, in place if n still
+// fits its block, else by moving it. A NULL ptr allocates, an n of 0 frees.
+// Returns pointer to the allocation on success, NULL on failure, in which
+// case ptr is left as it was.
+void* pool_realloc(void* ptr, size_t n);
+
+// Release allocation pointed to by ptr, which was allocated with n bytes.
+// Faster than pool_free since the pool is found from n. Compile with
+// POOL_DEBUG to abort when ptr isn't a block that fits n.
+void pool_free_sized(void* ptr, size_t n);
+
+// Allocate count objects of n bytes each into out.
+// Returns the number allocated, which is less than count when the pools
+// that fit n run out.
+size_t pool_malloc_batch(size_t n, void** out, size_t count);
+
+// Release the count allocations in ptrs. Invalid pointers are skipped.
+// Returns the number released.
+size_t pool_free_batch(void** ptrs, size_t count);
+
+// Allocate n bytes at an address that is a multiple of alignment, a power
+// of two up to 64. Block sizes are rounded up to a multiple of 8, and
+// blocks are aligned to the largest power of two (up to 64) their size is
+// a multiple of, so a pool whose block size fits n and is a multiple of
+// alignment must exist.
+// Returns pointer to allocate memory on success, NULL on failure.
+void* pool_memalign(size_t alignment, size_t n);
+
+// Initialize the pool allocator like pool_init, but give each pool a
+// share of the heap in proportion to weights[i] instead of an equal one.
+// Returns true on success, false on failure.
+bool pool_init_weighted(const size_t* block_sizes, const size_t* weights,
+                        size_t block_size_count);
+
+// Compute jemalloc style block sizes from min to max with spacing block
+// sizes per doubling, into block_sizes (room for 64 sizes).
+// Returns the number of block sizes, 0 on failure.
+size_t pool_geometric_sizes(size_t min, size_t max, size_t spacing,
+                            size_t* block_sizes);
+
+// Initialize the pool allocator with the block sizes computed by
+// pool_geometric_sizes.
+// Returns true on success, false on failure.
+bool pool_init_geometric(size_t min, size_t max, size_t spacing);
+
+// Initialize the pool allocator like pool_init, but on reserve_size bytes
+// of address space (at most 4 GB) that each pool maps as it runs out,
+// instead of the fixed 64 KB heap. pool_init moves back to that heap.
+// Returns true on success, false on failure.
+bool pool_init_growable(const size_t* block_sizes, size_t block_size_count,
+                        size_t reserve_size);
+
+// Initialize the pool allocator like pool_init, but hand the heap to the
+// pools one span (4 KB or more, enough for the largest block) at a time as
+// they run out, and take a span back for any pool to reuse once all of its
+// blocks are free, instead of giving each pool a fixed share.
+// Returns true on success, false on failure.
+bool pool_init_spans(const size_t* block_sizes, size_t block_size_count);
+
+// Initialize the pool allocator like pool_init_weighted, but thread the
+// free list of every pool through all of its blocks and fault the heap in
+// now, so that no allocation checks for untouched blocks or takes a page
+// fault. pool_init and its other variants switch this off again.
+// Returns true on success, false on failure.
+bool pool_init_eager(const size_t* block_sizes, const size_t* weights,
+                     size_t block_size_count);
+
+// Check whether ptr points into the heap of the pool allocator.
+bool pool_owns(const void* ptr);
+
+// Returns the number of bytes usable at the allocation pointed to by ptr,
+// 0 if ptr isn't an allocation of the pool allocator.
+size_t pool_usable_size(const void* ptr);
+
+// Counters of one pool, the sums over all threads since pool_init.
+typedef struct pool_class_stats {
+    size_t block_size;
+    // blocks handed out and freed, and the difference between them
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t live;
+    // the most blocks drawn from the pool at once, live or held in the
+    // caches of threads; an upper bound on the live blocks, not their peak
+    uint64_t drawn_peak;
+    // blocks handed out from memory never allocated before, and the
+    // blocks of such memory left in the pool (or in unused spans)
+    uint64_t carved;
+    uint64_t untouched;
+    // requests whose size maps to the pool that got NULL, and those
+    // served by a pool of larger blocks because the pool was full
+    uint64_t failed;
+    uint64_t spills;
+    // bytes asked for by the allocations the pool served, and the bytes
+    // of their blocks left over, its internal fragmentation
+    uint64_t requested;
+    uint64_t wasted;
+} pool_class_stats_t;
+
+typedef struct pool_stats {
+    size_t num_classes;
+    // requests larger than the largest block size
+    uint64_t oversized;
+    pool_class_stats_t classes[POOL_MAX_NUM_POOLS];
+    // every request by its size, see pool_hist_bucket, including those
+    // that failed
+    uint64_t histogram[POOL_HIST_BUCKETS];
+} pool_stats_t;
+
+// Fill stats with the counters of the pool allocator. Threads count in
+// their own caches, so the counters cost next to nothing to keep, and are
+// summed up here.
+void pool_get_stats(pool_stats_t* stats);
+
+// Print the counters of the pool allocator to out: a line per pool with
+// its fragmentation, then the histogram of requested sizes by the pool
+// they map to.
+void pool_dump_stats(FILE* out);
+
+// Compute at most max_classes block sizes that waste the fewest bytes on
+// the requests counted in histogram (POOL_HIST_BUCKETS buckets, like the
+// one in pool_stats_t), into block_sizes, and weights for
+// pool_init_weighted that give each pool a share of a heap of heap_size
+// bytes in proportion to the bytes requested from it, into weights. Both
+// need room for max_classes values.
+// Returns the number of block sizes, 0 on failure.
+size_t pool_tune(const uint64_t* histogram, size_t max_classes,
+                 size_t heap_size, size_t* block_sizes, size_t* weights);
+
+// Returns the bucket of the histogram that counts requests of n bytes.
+static inline size_t pool_hist_bucket(size_t n)
+{
+    if (n <= POOL_SMALL_SIZE_MAX) {
+        return (n + 7) >> 3;
+    }
+
+    size_t lg = 63 - __builtin_clzll((unsigned long long) n - 1);
+    size_t bucket = POOL_SMALL_SIZE_MAX/8 + 1 + (lg - 10)*4 +
+        (((n - 1) >> (lg - 2)) & 3);
+    return bucket < POOL_HIST_BUCKETS ? bucket : POOL_HIST_BUCKETS - 1;
+}
+
+// Returns the largest size counted by a bucket of the histogram.
+static inline size_t pool_hist_bucket_size(size_t bucket)
+{
+    if (bucket <= POOL_SMALL_SIZE_MAX/8) {
+        return bucket * 8;
+    }
+
+    size_t k = bucket - (POOL_SMALL_SIZE_MAX/8 + 1);
+    size_t lg = 10 + k/4;
+    return ((size_t) 1 << lg) + (k%4 + 1) * ((size_t) 1 << (lg - 2));
+}
+
+// Give every block cached by the calling thread back to the shared pools.
+// Threads do this automatically when they exit.
+void pool_thread_cache_flush(void);
+
+// Write the calls traced so far to the trace file, when pool_alloc.c is
+// compiled with POOL_TRACE (see pool_trace.h). Does nothing otherwise.
+void pool_trace_flush(void);
+
+// An independent allocator with a heap and pools of its own.
+typedef struct pool_ctx pool_ctx_t;
+
+// Create an allocator with a heap of heap_size bytes (at most 4 GB),
+// split into pools for the given block sizes like pool_init does.
+// Returns the allocator on success, NULL on failure.
+pool_ctx_t* pool_create(const size_t* block_sizes, size_t block_size_count,
+                        size_t heap_size);
+
+// Create an allocator like pool_create, but with reserve_size bytes of
+// address space (at most 4 GB) that each pool maps as it runs out.
+// Returns the allocator on success, NULL on failure.
+pool_ctx_t* pool_create_growable(const size_t* block_sizes,
+                                 size_t block_size_count,
+                                 size_t reserve_size);
+
+// Re-initialize an allocator with a new set of block sizes. Every
+// allocation made from it before becomes invalid.
+// Returns true on success, false on failure.
+bool pool_ctx_init(pool_ctx_t* ctx, const size_t* block_sizes,
+                   size_t block_size_count);
+
+// Re-initialize an allocator like pool_init_weighted.
+// Returns true on success, false on failure.
+bool pool_ctx_init_weighted(pool_ctx_t* ctx, const size_t* block_sizes,
+                            const size_t* weights, size_t block_size_count);
+
+// Re-initialize an allocator like pool_init_eager. A growable allocator
+// threads and faults in the memory it maps as it grows as well.
+// Returns true on success, false on failure.
+bool pool_ctx_init_eager(pool_ctx_t* ctx, const size_t* block_sizes,
+                         const size_t* weights, size_t block_size_count);
+
+// Re-initialize an allocator like pool_init_spans.
+// Returns true on success, false on failure.
+bool pool_ctx_init_spans(pool_ctx_t* ctx, const size_t* block_sizes,
+                         size_t block_size_count);
+
+// Release an allocator and its heap.
+void pool_destroy(pool_ctx_t* ctx);
+
+// Allocate n bytes from an allocator.
+// Returns pointer to allocate memory on success, NULL on failure.
+void* pool_ctx_malloc(pool_ctx_t* ctx, size_t n);
+
+// Allocate n bytes from an allocator, aligned like pool_memalign.
+// Returns pointer to allocate memory on success, NULL on failure.
+void* pool_ctx_memalign(pool_ctx_t* ctx, size_t alignment, size_t n);
+
+// Allocate a zeroed array from an allocator, like pool_calloc.
+// Returns pointer to allocate memory on success, NULL on failure.
+void* pool_ctx_calloc(pool_ctx_t* ctx, size_t nmemb, size_t size);
+
+// Resize an allocation from an allocator, like pool_realloc.
+// Returns pointer to the allocation on success, NULL on failure.
+void* pool_ctx_realloc(pool_ctx_t* ctx, void* ptr, size_t n);
+
+// Release allocation pointed to by ptr back to the allocator it came from.
+void pool_ctx_free(pool_ctx_t* ctx, void* ptr);
+
+// Release allocation pointed to by ptr, which was allocated with n bytes,
+// back to the allocator it came from, like pool_free_sized.
+void pool_ctx_free_sized(pool_ctx_t* ctx, void* ptr, size_t n);
+
+// Allocate count objects of n bytes each from an allocator into out.
+// Returns the number allocated.
+size_t pool_ctx_malloc_batch(pool_ctx_t* ctx, size_t n, void** out,
+                             size_t count);
+
+// Release the count allocations in ptrs back to the allocator they came
+// from. Returns the number released.
+size_t pool_ctx_free_batch(pool_ctx_t* ctx, void** ptrs, size_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+// Defining POOL_INLINE before including this header makes pool_malloc(n)
+// with a constant n inline, see pool_alloc_inline.h.
+#ifdef POOL_INLINE
+#include "pool_alloc_inline.h"
+#endif
+
+#endif
@@ -0,0 +1,158 @@
+/*
+ * @file pool_alloc.hpp
+ * @brief C++ allocator and memory resource on the tunable pool allocator
+ *
+ *
+ * pool::PoolAllocator<T> is a stateless allocator for standard
+ * containers and pool::PoolResource a std::pmr::memory_resource, both
+ * allocating from the global pools set up with pool_init. Requests the
+ * pools can't serve, because no pool fits them or the pools that do are
+ * full, go to operator new (or the upstream resource) instead, and
+ * deallocation tells the two apart with pool_owns.
+ *
+ * Containers pass the size back on deallocation, so blocks are freed
+ * with pool_free_sized and their pool is found from the size.
+ *
+ * @author Akash Arun <akasha@andrew.cmu.edu>
+*/
+
+#ifndef POOL_ALLOC_HPP
+#define POOL_ALLOC_HPP
+
+#include <cstddef>
+#include <limits>
+#include <new>
+#include <memory_resource>
+#include "pool_alloc.h"
+
+namespace pool {
+
+// The largest alignment pool_memalign serves, and the one every block has.
+constexpr std::size_t max_align = 64;
+constexpr std::size_t block_align = 8;
+
+/* @brief allocates bytes aligned to align from the pools
+ *
+ * returns the address of the allocated memory, or nullptr if the pools
+ * can't serve the request
+*/
+
+inline void* pool_allocate(std::size_t bytes, std::size_t align) noexcept
+{
+    if (align <= block_align) {
+        return pool_malloc(bytes);
+    }
+    return align <= max_align ? pool_memalign(align, bytes) : nullptr;
+}
+
+/* A stateless allocator that takes memory for Ts from the global pools.
+ * All instances are equal, so containers can move and swap memory
+ * between each other freely.
+*/
+
+template <typename T>
+class PoolAllocator {
+public:
+    using value_type = T;
+    using propagate_on_container_move_assignment = std::true_type;
+    using is_always_equal = std::true_type;
+
+    PoolAllocator() noexcept = default;
+
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>&) noexcept {}
+
+    T* allocate(std::size_t n)
+    {
+        if (n > std::numeric_limits<std::size_t>::max() / sizeof(T)) {
+            throw std::bad_array_new_length();
+        }
+
+        void* ptr = pool_allocate(n * sizeof(T), alignof(T));
+        if (ptr == nullptr) {
+            ptr = ::operator new(n * sizeof(T),
+                                 std::align_val_t(alignof(T)));
+        }
+        return static_cast<T*>(ptr);
+    }
+
+    void deallocate(T* ptr, std::size_t n) noexcept
+    {
+        if (pool_owns(ptr)) {
+            pool_free_sized(ptr, n * sizeof(T));
+        }
+        else {
+            ::operator delete(ptr, n * sizeof(T),
+                              std::align_val_t(alignof(T)));
+        }
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const PoolAllocator<T>&, const PoolAllocator<U>&) noexcept
+{
+    return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const PoolAllocator<T>&, const PoolAllocator<U>&) noexcept
+{
+    return false;
+}
+
+/* A memory resource on the global pools that passes the requests they
+ * can't serve to an upstream resource, new_delete_resource by default.
+*/
+
+class PoolResource : public std::pmr::memory_resource {
+public:
+    explicit PoolResource(std::pmr::memory_resource* upstream =
+                              std::pmr::new_delete_resource()) noexcept
+        : upstream_(upstream) {}
+
+    std::pmr::memory_resource* upstream_resource() const noexcept
+    {
+        return upstream_;
+    }
+
+protected:
+    void* do_allocate(std::size_t bytes, std::size_t align) override
+    {
+        void* ptr = pool_allocate(bytes, align);
+        return ptr != nullptr ? ptr : upstream_->allocate(bytes, align);
+    }
+
+    void do_deallocate(void* ptr, std::size_t bytes,
+                       std::size_t align) override
+    {
+        if (pool_owns(ptr)) {
+            pool_free_sized(ptr, bytes);
+        }
+        else {
+            upstream_->deallocate(ptr, bytes, align);
+        }
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other)
+        const noexcept override
+    {
+        // blocks of the pools can be freed by any PoolResource, but the
+        // rest only by one with the same upstream
+        const PoolResource* pool = dynamic_cast<const PoolResource*>(&other);
+        return pool != nullptr && *pool->upstream_ == *upstream_;
+    }
+
+private:
+    std::pmr::memory_resource* upstream_;
+};
+
+// A PoolResource on new_delete_resource shared by the whole program.
+inline PoolResource* resource() noexcept
+{
+    static PoolResource shared;
+    return &shared;
+}
+
+}  // namespace pool
+
+#endif
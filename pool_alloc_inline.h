@@ -0,0 +1,111 @@
+/*
+ * @file pool_alloc_inline.h
+ * @brief inline fast path of pool_malloc
+ *
+ *
+ * Lets pool_malloc(n) with a constant n pop a block off the calling
+ * thread's cache inline. Only refills, sizes above POOL_SMALL_SIZE_MAX
+ * and the first call of a thread after pool_init call into
+ * pool_alloc.c.
+ *
+ * The thread cache layout below is shared with pool_alloc.c, so code
+ * compiled with it has to be rebuilt whenever pool_alloc.c changes.
+ * Callers opt in by defining POOL_INLINE before including pool_alloc.h;
+ * none of it is meant to be used directly.
+ *
+ * @author Akash Arun <akasha@andrew.cmu.edu>
+*/
+
+#ifndef POOL_ALLOC_INLINE_H
+#define POOL_ALLOC_INLINE_H
+
+#include "pool_alloc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef __cplusplus
+#define POOL_THREAD_LOCAL thread_local
+#else
+#define POOL_THREAD_LOCAL _Thread_local
+#endif
+
+struct pool_block;
+
+// A thread cache, see pool_alloc.c.
+typedef struct pool_tcache_bin {
+    struct pool_block* head;
+    size_t count;
+    size_t fresh;
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t failed;
+    uint64_t spills;
+    uint64_t requested;
+} pool_tcache_bin_t;
+
+typedef struct pool_tcache {
+    uint64_t epoch;
+    bool registered;
+    struct pool_tcache* next;
+    struct pool_tcache* prev;
+    uint64_t oversized;
+    pool_tcache_bin_t bins[POOL_MAX_NUM_POOLS];
+    uint64_t histogram[POOL_HIST_BUCKETS];
+} pool_tcache_t;
+
+// The epoch of the latest pool_init, and the pool for each size up to
+// POOL_SMALL_SIZE_MAX, indexed by (n+7)>>3.
+typedef struct pool_fast {
+    uint64_t epoch;
+    uint8_t small_class[POOL_SMALL_SIZE_MAX/8 + 1];
+} pool_fast_t;
+
+extern pool_fast_t pool_fast;
+extern POOL_THREAD_LOCAL pool_tcache_t pool_tcache;
+
+// Allocate n bytes, popping a block off the calling thread's cache when
+// it has one for n and was filled after the latest pool_init.
+static inline void* pool_malloc_inline(size_t n)
+{
+    if (n >= 1 && n <= POOL_SMALL_SIZE_MAX) {
+        pool_tcache_t* tc = &pool_tcache;
+        size_t i = pool_fast.small_class[(n + 7) >> 3];
+
+        if (i < POOL_MAX_NUM_POOLS && tc->bins[i].count > 0 &&
+            tc->epoch == __atomic_load_n(&pool_fast.epoch,
+                                         __ATOMIC_ACQUIRE)) {
+            pool_tcache_bin_t* bin = &tc->bins[i];
+            struct pool_block* block = bin->head;
+
+            bin->head = *(struct pool_block**) block;
+            bin->count--;
+            // only this thread writes its counters, pool_get_stats reads
+            // them, and the bucket of a constant n is a constant too
+            size_t bucket = pool_hist_bucket(n);
+            __atomic_store_n(&bin->allocs, bin->allocs + 1,
+                             __ATOMIC_RELAXED);
+            __atomic_store_n(&bin->requested, bin->requested + n,
+                             __ATOMIC_RELAXED);
+            __atomic_store_n(&tc->histogram[bucket],
+                             tc->histogram[bucket] + 1, __ATOMIC_RELAXED);
+            if (bin->fresh > bin->count) {
+                bin->fresh = bin->count;
+            }
+            return block;
+        }
+    }
+    return (pool_malloc)(n);
+}
+
+#ifndef POOL_ALLOC_INTERNAL
+#define pool_malloc(n) \
+    (__builtin_constant_p(n) ? pool_malloc_inline(n) : (pool_malloc)(n))
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -6,9 +6,82 @@
 */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <pthread.h>
+#define POOL_INLINE
 #include "pool_alloc.h"
+#include "pool_trace.h"
+
+#define NUM_THREADS 4
+
+// allocates and frees every 1238 byte block, leaving them in the
+// thread's cache when it exits
+void *take_large_blocks(void *arg)
+{
+    void *blocks[13];
+
+    for (size_t i = 0; i < 13; i++) {
+        blocks[i] = pool_malloc(1238);
+    }
+    for (size_t i = 0; i < 13; i++) {
+        pool_free(blocks[i]);
+    }
+    return arg;
+}
+
+// repeatedly fills blocks with the thread id and checks that no other
+// thread was handed the same block
+void *churn_blocks(void *arg)
+{
+    long id = (long) arg;
+    long *blocks[100];
+
+    for (size_t round = 0; round < 1000; round++) {
+        for (size_t i = 0; i < 100; i++) {
+            blocks[i] = pool_malloc(sizeof(long));
+            if (blocks[i] == NULL) {
+                return (void *) 1;
+            }
+            *blocks[i] = id;
+        }
+        for (size_t i = 0; i < 100; i++) {
+            if (*blocks[i] != id) {
+                return (void *) 1;
+            }
+            pool_free(blocks[i]);
+        }
+    }
+    return NULL;
+}
+
+// same as churn_blocks but every free goes straight back to the shared
+// pool, so that all threads push and pop on the same free list
+void *churn_shared_pool(void *arg)
+{
+    long id = (long) arg;
+    long *blocks[8];
+
+    for (size_t round = 0; round < 20000; round++) {
+        for (size_t i = 0; i < 8; i++) {
+            blocks[i] = pool_malloc(sizeof(long));
+            if (blocks[i] == NULL) {
+                return (void *) 1;
+            }
+            *blocks[i] = id;
+        }
+        for (size_t i = 0; i < 8; i++) {
+            if (*blocks[i] != id) {
+                return (void *) 1;
+            }
+            pool_free(blocks[i]);
+        }
+        pool_thread_cache_flush();
+    }
+    return NULL;
+}
 
 int main() {
 
@@ -30,10 +103,14 @@ int main() {
         printf("........Passed");
     }
 
-    printf("\n2. Testing if false when block size is > 4 ");
+    printf("\n2. Testing if false when block size is > 64 ");
 
+    size_t test_many[65];
+    for (size_t i = 0; i < 65; i++) {
+        test_many[i] = 8 * (i + 1);
+    }
 
-    if (pool_init(test1, 8)) {
+    if (pool_init(test_many, 65)) {
         printf("........Failed");
         return 0;
     }
@@ -287,6 +364,1276 @@ int main() {
     printf("\n");
     printf("\n");
 
+    // thread cache test cases:
+
+    printf("Testing thread caches:\n");
+
+
+    printf("\n1. Testing if blocks cached by a thread are given back\n"
+            "   when the thread exits ");
+
+    pool_init(test2, 4);
+
+    pthread_t threads[NUM_THREADS];
+    pthread_create(&threads[0], NULL, take_large_blocks, NULL);
+    pthread_join(threads[0], NULL);
+
+    for (size_t i= 0; i<13; i++) {
+
+        if (pool_malloc(1238) == NULL) {
+            printf("........Failed");
+            return 0;
+        }
+    }
+
+    printf("........Passed");
+
+    printf("\n2. Testing if threads allocating concurrently never\n"
+            "   get the same block ");
+
+    pool_init(test2, 4);
+
+    for (long i = 0; i < NUM_THREADS; i++) {
+        pthread_create(&threads[i], NULL, churn_blocks, (void *) i);
+    }
+    bool churn_failed = false;
+    for (size_t i = 0; i < NUM_THREADS; i++) {
+        void *result;
+        pthread_join(threads[i], &result);
+        if (result != NULL) {
+            churn_failed = true;
+        }
+    }
+
+    if (churn_failed) {
+        printf("........Failed");
+        return 0;
+    }
+
+    printf("........Passed");
+
+    printf("\n3. Testing if a flushed thread cache hands its blocks\n"
+            "   back in the order they were freed ");
+
+    testa = pool_malloc(sizeof(long));
+    tesla = pool_malloc(sizeof(long));
+    pool_free(testa);
+    pool_free(tesla);
+    pool_thread_cache_flush();
+
+    if (pool_malloc(sizeof(long)) != tesla ||
+        pool_malloc(sizeof(long)) != testa) {
+        printf("........Failed");
+        return 0;
+    }
+
+    printf("........Passed");
+    printf("\n");
+    printf("\n");
+
+    // lock-free pool test cases:
+
+    printf("Testing lock-free pools:\n");
+
+
+    printf("\n1. Testing if threads pushing and popping on the same\n"
+            "   pool without a lock never get the same block ");
+
+    pool_init(test2, 4);
+
+    for (long i = 0; i < NUM_THREADS; i++) {
+        pthread_create(&threads[i], NULL, churn_shared_pool, (void *) i);
+    }
+    churn_failed = false;
+    for (size_t i = 0; i < NUM_THREADS; i++) {
+        void *result;
+        pthread_join(threads[i], &result);
+        if (result != NULL) {
+            churn_failed = true;
+        }
+    }
+
+    // every block must be back in the pool, so 512 allocations fit
+    // in the 16384 bytes of the 32 byte pool without spilling
+    char *lowest = NULL, *highest = NULL;
+    for (size_t i= 0; i<512; i++) {
+
+        char *block = pool_malloc(32);
+        if (block == NULL) {
+            churn_failed = true;
+            break;
+        }
+        if (lowest == NULL || block < lowest) {
+            lowest = block;
+        }
+        if (highest == NULL || block > highest) {
+            highest = block;
+        }
+    }
+    if (highest - lowest >= 16384) {
+        churn_failed = true;
+    }
+
+    if (churn_failed) {
+        printf("........Failed");
+        return 0;
+    }
+
+    printf("........Passed");
+    printf("\n");
+    printf("\n");
+
+    // allocator instance test cases:
+
+    printf("Testing allocator instances:\n");
+
+
+    printf("\n1. Testing if NULL when the parameters are invalid ");
+
+    size_t test3[2];
+    test3[0] = 64;
+    test3[1] = 1238;
+
+    if (pool_create(NULL, 2, 16384) != NULL ||
+        pool_create(test3, 2, 0) != NULL ||
+        pool_create(test3, 2, 2048) != NULL) {
+        printf("........Failed");
+        return 0;
+    }
+
+    printf("........Passed");
+
+    printf("\n2. Testing if instances don't share memory with each other\n"
+            "   or with the global pools ");
+
+    pool_ctx_t *ctx1 = pool_create(test3, 2, 16384);
+    pool_ctx_t *ctx2 = pool_create(test3, 2, 16384);
+
+    if (ctx1 == NULL || ctx2 == NULL) {
+        printf("........Failed");
+        return 0;
+    }
+
+    // 6 since (16384/2)/1238 is 6
+    for (size_t i= 0; i<6; i++) {
+
+        if (pool_ctx_malloc(ctx1, 1238) == NULL) {
+            printf("........Failed");
+            return 0;
+        }
+    }
+
+    if (pool_ctx_malloc(ctx1, 1238) != NULL ||
+        pool_ctx_malloc(ctx2, 1238) == NULL) {
+        printf("........Failed");
+        return 0;
+    }
+
+    // a block of another allocator is ignored
+    testa = pool_malloc(sizeof(long));
+    pool_ctx_free(ctx1, testa);
+    if (pool_ctx_malloc(ctx1, sizeof(long)) == testa) {
+        printf("........Failed");
+        return 0;
+    }
+
+    printf("........Passed");
+
+    printf("\n3. Testing if free works as intended on an instance ");
+
+    testa = pool_ctx_malloc(ctx2, sizeof(long));
+    tesla = pool_ctx_malloc(ctx2, sizeof(long));
+    pool_ctx_free(ctx2, testa);
+    pool_ctx_free(ctx2, tesla);
+
+    if (pool_ctx_malloc(ctx2, sizeof(long)) != tesla ||
+        pool_ctx_malloc(ctx2, sizeof(long)) != testa) {
+        printf("........Failed");
+        return 0;
+    }
+
+    pool_destroy(ctx1);
+    pool_destroy(ctx2);
+
+    printf("........Passed");
+    printf("\n");
+    printf("\n");
+
+    // size class lookup test cases:
+
+    printf("Testing size class lookup:\n");
+
+
+    printf("\n1. Testing if block sizes given out of order work ");
+
+    size_t test4[4];
+    test4[0] = 1238;
+    test4[1] = 32;
+    test4[2] = 547;
+    test4[3] = 64;
+
+    if (!pool_init(test4, 4)) {
+        printf("........Failed");
+        return 0;
+    }
+
+    for (size_t i= 0; i<13; i++) {
+
+        if (pool_malloc(1238) == NULL) {
+            printf("........Failed");
+            return 0;
+        }
+    }
+
+    if (pool_malloc(1238) != NULL || pool_malloc(5000) != NULL) {
+        printf("........Failed");
+        return 0;
+    }
+
+    printf("........Passed");
+
+    printf("\n2. Testing if a size is served by the smallest fitting\n"
+            "   block size when several share a power of two ");
+
+    test4[0] = 1100;
+    test4[1] = 1500;
+    test4[2] = 2000;
+    test4[3] = 4000;
+
+    pool_init(test4, 4);
+
+    // 22 since (65536/4)/1500 + (65536/4)/2000 + (65536/4)/4000 is 22
+    for (size_t i= 0; i<22; i++) {
+
+        if (pool_malloc(1400) == NULL) {
+            printf("........Failed");
+            return 0;
+        }
+    }
+
+    if (pool_malloc(1400) != NULL || pool_malloc(1100) == NULL) {
+        printf("........Failed");
+        return 0;
+    }
+
+    printf("........Passed");
+    printf("\n");
+    printf("\n");
+
+    // pointer validation test cases:
+
+    printf("Testing pointer validation in pool_free:\n");
+
+
+    printf("\n1. Testing if pointers into the middle of a block\n"
+            "   are ignored ");
+
+    pool_init(test2, 4);
+
+    char *block = pool_malloc(500);
+    pool_free(block + 1);
+    pool_free(block + 273);
+    pool_free(block + 547 + 8);
+
+    for (size_t i= 0; i<28; i++) {
+
+        char *next = pool_malloc(500);
+        if (next == NULL || next == block + 1 || next == block + 273 ||
+            next == block + 547 + 8) {
+            printf("........Failed");
+            return 0;
+        }
+    }
+
+    printf("........Passed");
+
+    printf("\n2. Testing if the start of a block is still accepted ");
+
+    pool_free(block);
+
+    if (pool_malloc(500) != block) {
+        printf("........Failed");
+        return 0;
+    }
+
+    printf("........Passed");
+    printf("\n");
+    printf("\n");
+
+    // growable heap test cases:
+
+    printf("Testing growable heaps:\n");
+
+
+    printf("\n1. Testing if a growable instance keeps allocating\n"
+            "   far past its first mapping ");
+
+    ctx1 = pool_create_growable(test3, 2, (size_t) 64 << 20);
+
+    if (ctx1 == NULL) {
+        printf("........Failed");
+        return 0;
+    }
+
+    // 20000 blocks of 1238 bytes are about 24 MB
+    int *previous = NULL;
+    for (int i= 0; i<20000; i++) {
+
+        int *next = pool_ctx_malloc(ctx1, 1238);
+        if (next == NULL || next == previous) {
+            printf("........Failed");
+            return 0;
+        }
+        *next = i;
+        if (previous != NULL && *previous != i - 1) {
+            printf("........Failed");
+            return 0;
+        }
+        previous = next;
+    }
+
+    printf("........Passed");
+
+    printf("\n2. Testing if a growable instance still runs out\n"
+            "   once its reserved range is used ");
+
+    // 27060 since 1238 rounds up to 1240 and (64 MB/2)/1240 is 27060
+    for (int i= 20000; i<27060; i++) {
+
+        if (pool_ctx_malloc(ctx1, 1238) == NULL) {
+            printf("........Failed");
+            return 0;
+        }
+    }
+
+    if (pool_ctx_malloc(ctx1, 1238) != NULL) {
+        printf("........Failed");
+        return 0;
+    }
+
+    pool_destroy(ctx1);
+
+    printf("........Passed");
+
+    printf("\n3. Testing if the global pools can grow and go back\n"
+            "   to the fixed heap ");
+
+    if (!pool_init_growable(test2, 4, (size_t) 16 << 20)) {
+        printf("........Failed");
+        return 0;
+    }
+
+    for (size_t i= 0; i<1000; i++) {
+
+        if (pool_malloc(1238) == NULL) {
+            printf("........Failed");
+            return 0;
+        }
+    }
+
+    pool_init(test2, 4);
+
+    for (size_t i= 0; i<13; i++) {
+
+        if (pool_malloc(1238) == NULL) {
+            printf("........Failed");
+            return 0;
+        }
+    }
+
+    if (pool_malloc(1238) != NULL) {
+        printf("........Failed");
+        return 0;
+    }
+
+    printf("........Passed");
+    printf("\n");
+    printf("\n");
+
+    // geometric block size test cases:
+
+    printf("Testing geometric block sizes:\n");
+
+
+    printf("\n1. Testing if the block sizes grow by spacing steps\n"
+            "   per doubling ");
+
+    size_t sizes[64];
+
+    // 8 to 64 in steps of 8, then 4 steps per doubling, ending at 200
+    size_t expected[15] = { 8, 16, 24, 32, 40, 48, 56, 64,
+                            80, 96, 112, 128, 160, 192, 200 };
+    if (pool_geometric_sizes(1, 200, 4, sizes) != 15) {
+        printf("........Failed");
+        return 0;
+    }
+    for (size_t i = 0; i < 15; i++) {
+        if (sizes[i] != expected[i]) {
+            printf("........Failed");
+            return 0;
+        }
+    }
+
+    printf("........Passed");
+
+    printf("\n2. Testing if false when more than 64 block sizes\n"
+            "   would be needed ");
+
+    if (pool_geometric_sizes(8, 2048, 16, sizes) != 0 ||
+        pool_init_geometric(8, 2048, 16)) {
+        printf("........Failed");
+        return 0;
+    }
+
+    printf("........Passed");
+
+    printf("\n3. Testing if every size works with 64 pools ");
+
+    if (pool_geometric_sizes(8, 1024, 16, sizes) != 64 ||
+        !pool_init_geometric(8, 1024, 16)) {
+        printf("........Failed");
+        return 0;
+    }
+
+    for (size_t n = 1; n <= 1024; n++) {
+        char *next = pool_malloc(n);
+        if (next == NULL) {
+            printf("........Failed");
+            return 0;
+        }
+        next[n - 1] = 1;
+        pool_free(next);
+    }
+
+    // 1024 since 65536/64 is 1024, so the last pool has one block
+    if (pool_malloc(1024) == NULL || pool_malloc(1024) != NULL) {
+        printf("........Failed");
+        return 0;
+    }
+
+    printf("........Passed");
+    printf("\n");
+    printf("\n");
+
+    // weighted pool test cases:
+
+    printf("Testing weighted pools:\n");
+
+
+    printf("\n1. Testing if false when a weight is 0 ");
+
+    size_t weights[2];
+    weights[0] = 1;
+    weights[1] = 0;
+
+    if (pool_init_weighted(test3, weights, 2)) {
+        printf("........Failed");
+        return 0;
+    }
+
+    printf("........Passed");
+
+    printf("\n2. Testing if pools get a share of the heap in\n"
+            "   proportion to their weights ");
+
+    test3[0] = 1238;
+    test3[1] = 32;
+    weights[0] = 3;
+    weights[1] = 1;
+
+    if (!pool_init_weighted(test3, weights, 2)) {
+        printf("........Failed");
+        return 0;
+    }
+
+    // 39 since (65536*3/4)/1238 is 39
+    for (size_t i= 0; i<39; i++) {
+
+        if (pool_malloc(1238) == NULL) {
+            printf("........Failed");
+            return 0;
+        }
+    }
+
+    if (pool_malloc(1238) != NULL) {
+        printf("........Failed");
+        return 0;
+    }
+
+    // 512 since (65536/4)/32 is 512, and nothing left to spill into
+    for (size_t i= 0; i<512; i++) {
+
+        if (pool_malloc(32) == NULL) {
+            printf("........Failed");
+            return 0;
+        }
+    }
+
+    if (pool_malloc(32) != NULL) {
+        printf("........Failed");
+        return 0;
+    }
+
+    printf("........Passed");
+
+    printf("\n3. Testing if a heap that isn't a whole number of pages\n"
+            "   gets pages that cover its last bytes ");
+
+    // 4096 pages of 256 bytes and 100 bytes more take pages of 512
+    // bytes, 1366 of the 2048 go to the 1238 byte pool and 564 since
+    // 1366*512/1240 is 564, where pages of 256 bytes would fit 563
+    weights[0] = 2;
+    weights[1] = 1;
+    ctx1 = pool_create(test3, 2, (4096 << 8) + 100);
+    if (ctx1 == NULL || !pool_ctx_init_weighted(ctx1, test3, weights, 2)) {
+        printf("........Failed");
+        return 0;
+    }
+
+    uint8_t *first_block = pool_ctx_malloc(ctx1, 32);
+    for (size_t i= 0; i<564; i++) {
+
+        if (pool_ctx_malloc(ctx1, 1238) == NULL) {
+            printf("........Failed");
+            return 0;
+        }
+    }
+
+    if (pool_ctx_malloc(ctx1, 1238) != NULL) {
+        printf("........Failed");
+        return 0;
+    }
+
+    // the 32 byte pool comes first, so the partial page is this far in
+    pool_ctx_free(ctx1, first_block + (4096 << 8));
+    pool_ctx_free(ctx1, first_block);
+    if (pool_ctx_malloc(ctx1, 32) != first_block) {
+        printf("........Failed");
+        return 0;
+    }
+    pool_destroy(ctx1);
+
+    printf("........Passed");
+    printf("\n");
+    printf("\n");
+
+    printf("Testing spans:\n");
+
+
+    printf("\n1. Testing if one pool can take every span ");
+
+    void *span_blocks[48];
+
+    if (!pool_init_spans(test2, 4)) {
+        printf("........Failed");
+        return 0;
+    }
+
+    // 48 since the heap has 16 spans of 4096 bytes, of 3 blocks each
+    for (size_t i= 0; i<48; i++) {
+
+        span_blocks[i] = pool_malloc(1238);
+        if (span_blocks[i] == NULL) {
+            printf("........Failed");
+            return 0;
+        }
+    }
+
+    if (pool_malloc(1238) != NULL || pool_malloc(32) != NULL) {
+        printf("........Failed");
+        return 0;
+    }
+
+    printf("........Passed");
+
+    printf("\n2. Testing if freed spans go to another pool ");
+
+    for (size_t i= 0; i<48; i++) {
+        pool_free(span_blocks[i]);
+    }
+    pool_thread_cache_flush();
+
+    // 2048 since all 16 spans now hold 128 blocks of 32 bytes each
+    char *small_block = NULL;
+    for (size_t i= 0; i<2048; i++) {
+
+        small_block = pool_malloc(32);
+        if (small_block == NULL) {
+            printf("........Failed");
+            return 0;
+        }
+    }
+
+    if (pool_malloc(32) != NULL || pool_malloc(1238) != NULL) {
+        printf("........Failed");
+        return 0;
+    }
+
+    printf("........Passed");
+
+    printf("\n3. Testing if pointers into the middle of a span's\n"
+            "   blocks are ignored ");
+
+    pool_free(small_block + 8);
+    pool_thread_cache_flush();
+
+    if (pool_malloc(32) != NULL) {
+        printf("........Failed");
+        return 0;
+    }
+
+    pool_free(small_block);
+    if (pool_malloc(32) != small_block) {
+        printf("........Failed");
+        return 0;
+    }
+
+    printf("........Passed");
+
+    printf("\n4. Testing if pointers after the last span are ignored ");
+
+    size_t span_sizes[64];
+    size_t span_count = pool_geometric_sizes(16, 1024, 4, span_sizes);
+
+    // 4095 spans of 4096 bytes and 200 bytes that make no span, the
+    // most spans of 4096 bytes that still leave room for a partial one
+    ctx1 = pool_create(span_sizes, span_count, 4095*4096 + 200);
+    if (ctx1 == NULL ||
+        !pool_ctx_init_spans(ctx1, span_sizes, span_count)) {
+        printf("........Failed");
+        return 0;
+    }
+
+    // the first block of the first span is the start of the heap
+    uint8_t *span_heap = pool_ctx_malloc(ctx1, 16);
+    pool_ctx_free(ctx1, span_heap + 4095*4096);
+#ifndef POOL_DEBUG
+    // debug builds abort on sized frees of pointers never handed out
+    pool_ctx_free_sized(ctx1, span_heap + 4095*4096, 16);
+#endif
+    pool_ctx_free(ctx1, span_heap);
+    if (pool_ctx_malloc(ctx1, 16) != span_heap) {
+        printf("........Failed");
+        return 0;
+    }
+    pool_destroy(ctx1);
+
+    printf("........Passed");
+    printf("\n");
+    printf("\n");
+
+    printf("Testing batches:\n");
+
+
+    printf("\n1. Testing if a batch stops when the pools run out ");
+
+    static void *batch[600];
+
+    if (!pool_init(test2, 4)) {
+        printf("........Failed");
+        return 0;
+    }
+
+    // 13 since 16384/1238 is 13
+    if (pool_malloc_batch(1238, batch, 20) != 13 ||
+        pool_malloc(1238) != NULL) {
+        printf("........Failed");
+        return 0;
+    }
+
+    printf("........Passed");
+
+    printf("\n2. Testing if a freed batch can be allocated again ");
+
+    if (pool_free_batch(batch, 13) != 13 ||
+        pool_malloc_batch(1238, batch, 13) != 13) {
+        printf("........Failed");
+        return 0;
+    }
+
+    printf("........Passed");
+
+    printf("\n3. Testing if a batch spills into larger pools ");
+
+    // 512 blocks of 32 bytes and 88 of 64 bytes
+    if (pool_malloc_batch(32, batch, 600) != 600 ||
+        pool_malloc(32) == NULL) {
+        printf("........Failed");
+        return 0;
+    }
+
+    batch[100] = NULL;
+    if (pool_free_batch(batch, 600) != 599 ||
+        pool_malloc_batch(32, batch, 600) != 600) {
+        printf("........Failed");
+        return 0;
+    }
+
+    printf("........Passed");
+
+    printf("\n4. Testing batches on an instance ");
+
+    ctx1 = pool_create(test2, 4, 65536);
+    if (ctx1 == NULL ||
+        pool_ctx_malloc_batch(ctx1, 1238, batch, 20) != 13 ||
+        pool_ctx_free_batch(ctx1, batch, 13) != 13 ||
+        pool_ctx_malloc_batch(ctx1, 1238, batch, 20) != 13) {
+        printf("........Failed");
+        return 0;
+    }
+    pool_destroy(ctx1);
+
+    printf("........Passed");
+    printf("\n");
+    printf("\n");
+
+    printf("Testing sized free:\n");
+
+
+    printf("\n1. Testing if a block freed with its size is reused ");
+
+    if (!pool_init(test2, 4)) {
+        printf("........Failed");
+        return 0;
+    }
+
+    char *sized_block = pool_malloc(40);
+    pool_free_sized(sized_block, 40);
+
+    if (sized_block == NULL || pool_malloc(64) != sized_block) {
+        printf("........Failed");
+        return 0;
+    }
+
+    printf("........Passed");
+
+    printf("\n2. Testing if a block that spilled into a larger pool\n"
+            "   goes back to that pool ");
+
+    // 29 since 16384/547 is 29
+    for (size_t i= 0; i<29; i++) {
+
+        if (pool_malloc(547) == NULL) {
+            printf("........Failed");
+            return 0;
+        }
+    }
+
+    sized_block = pool_malloc(547);
+    pool_free_sized(sized_block, 547);
+
+    if (sized_block == NULL || pool_malloc(547) != sized_block) {
+        printf("........Failed");
+        return 0;
+    }
+
+    pool_free_sized(sized_block, 547);
+    if (pool_malloc(1238) != sized_block) {
+        printf("........Failed");
+        return 0;
+    }
+
+    printf("........Passed");
+    printf("\n");
+    printf("\n");
+
+    printf("Testing alignment:\n");
+
+
+    printf("\n1. Testing if blocks of any size are 8 byte aligned ");
+
+    size_t test_align[4] = {547, 32, 100, 64};
+
+    if (!pool_init(test_align, 4)) {
+        printf("........Failed");
+        return 0;
+    }
+
+    for (size_t i= 0; i<29; i++) {
+
+        char *aligned_block = pool_malloc(547);
+        if (aligned_block == NULL || (uintptr_t) aligned_block % 8 != 0) {
+            printf("........Failed");
+            return 0;
+        }
+    }
+
+    printf("........Passed");
+
+    printf("\n2. Testing if pool_memalign uses pools aligned enough ");
+
+    for (size_t i= 0; i<100; i++) {
+
+        char *a32 = pool_memalign(32, 20);
+        char *a64 = pool_memalign(64, 40);
+        if (a32 == NULL || (uintptr_t) a32 % 32 != 0 ||
+            a64 == NULL || (uintptr_t) a64 % 64 != 0) {
+            printf("........Failed");
+            return 0;
+        }
+    }
+
+    printf("........Passed");
+
+    printf("\n3. Testing if NULL when no pool is aligned enough ");
+
+    // the pools with blocks of 100 bytes or more are only 8 byte aligned
+    if (pool_memalign(32, 100) != NULL || pool_memalign(48, 8) != NULL ||
+        pool_memalign(128, 8) != NULL || pool_memalign(0, 8) != NULL) {
+        printf("........Failed");
+        return 0;
+    }
+
+    printf("........Passed");
+    printf("\n");
+    printf("\n");
+
+    printf("Testing realloc and calloc:\n");
+
+
+    printf("\n1. Testing if realloc keeps an object that still fits ");
+
+    if (!pool_init(test2, 4)) {
+        printf("........Failed");
+        return 0;
+    }
+
+    char *resized = pool_malloc(20);
+    for (int i= 0; i<20; i++) {
+        resized[i] = (char) i;
+    }
+
+    if (pool_realloc(resized, 32) != resized) {
+        printf("........Failed");
+        return 0;
+    }
+
+    printf("........Passed");
+
+    printf("\n2. Testing if realloc moves an object that doesn't fit ");
+
+    char *moved = pool_realloc(resized, 500);
+    if (moved == NULL || moved == resized) {
+        printf("........Failed");
+        return 0;
+    }
+
+    for (int i= 0; i<20; i++) {
+
+        if (moved[i] != (char) i) {
+            printf("........Failed");
+            return 0;
+        }
+    }
+
+    if (pool_realloc(moved, 5000) != NULL || moved[19] != 19) {
+        printf("........Failed");
+        return 0;
+    }
+
+    printf("........Passed");
+
+    printf("\n3. Testing if calloc zeroes new and reused blocks ");
+
+    unsigned char *zeroed = pool_calloc(1, 1238);
+    if (zeroed == NULL) {
+        printf("........Failed");
+        return 0;
+    }
+
+    for (int i= 0; i<1238; i++) {
+
+        if (zeroed[i] != 0) {
+            printf("........Failed");
+            return 0;
+        }
+        zeroed[i] = 0xff;
+    }
+
+    pool_free(zeroed);
+    if (pool_calloc(2, 619) != zeroed) {
+        printf("........Failed");
+        return 0;
+    }
+
+    for (int i= 0; i<1238; i++) {
+
+        if (zeroed[i] != 0) {
+            printf("........Failed");
+            return 0;
+        }
+    }
+
+    if (pool_calloc(SIZE_MAX, 2) != NULL) {
+        printf("........Failed");
+        return 0;
+    }
+
+    printf("........Passed");
+    printf("\n");
+    printf("\n");
+
+    printf("Testing ownership:\n");
+
+
+    printf("\n1. Testing if pool_owns tells pool and other memory\n"
+            "   apart ");
+
+    char *owned = pool_malloc(100);
+    int not_owned;
+
+    if (owned == NULL || !pool_owns(owned) || !pool_owns(owned + 1) ||
+        pool_owns(&not_owned) || pool_owns(NULL)) {
+        printf("........Failed");
+        return 0;
+    }
+
+    printf("........Passed");
+
+    printf("\n2. Testing if usable size is the block size ");
+
+    // 100 goes to the pool of 547 byte blocks, rounded up to 552
+    if (pool_usable_size(owned) != 552 || pool_usable_size(owned + 1) != 0 ||
+        pool_usable_size(&not_owned) != 0) {
+        printf("........Failed");
+        return 0;
+    }
+
+    printf("........Passed");
+    printf("\n");
+    printf("\n");
+
+    printf("Testing inline allocation:\n");
+
+
+    printf("\n1. Testing if constant and variable sizes share the\n"
+            "   thread cache ");
+
+    if (!pool_init(test2, 4)) {
+        printf("........Failed");
+        return 0;
+    }
+
+    volatile size_t variable_size = 32;
+    char *inlined = pool_malloc(32);
+    pool_free(inlined);
+
+    if (inlined == NULL || pool_malloc(variable_size) != inlined) {
+        printf("........Failed");
+        return 0;
+    }
+
+    pool_free(inlined);
+    if (pool_malloc(32) != inlined) {
+        printf("........Failed");
+        return 0;
+    }
+
+    printf("........Passed");
+
+    printf("\n2. Testing if cached blocks are dropped by pool_init ");
+
+    pool_free(inlined);
+
+    size_t test_inline[2] = {64, 128};
+    if (!pool_init(test_inline, 2)) {
+        printf("........Failed");
+        return 0;
+    }
+
+    if (pool_usable_size(pool_malloc(32)) != 64) {
+        printf("........Failed");
+        return 0;
+    }
+
+    printf("........Passed");
+    printf("\n");
+    printf("\n");
+
+    printf("Testing stats:\n");
+
+
+    printf("\n1. Testing if allocations, spills and oversized requests\n"
+            "   are counted ");
+
+    if (!pool_init(test2, 4)) {
+        printf("........Failed");
+        return 0;
+    }
+
+    // 513 since 16384/32 is 512, the last spills into the 64 byte pool
+    static void *counted[513];
+    for (size_t i = 0; i < 513; i++) {
+        counted[i] = pool_malloc(32);
+    }
+    pool_malloc(5000);
+
+    pool_stats_t stats;
+    pool_get_stats(&stats);
+    if (stats.num_classes != 4 || stats.oversized != 1 ||
+        stats.classes[0].allocs != 512 || stats.classes[0].spills != 1 ||
+        stats.classes[1].allocs != 1 || stats.classes[0].live != 512 ||
+        stats.classes[0].carved != 512 || stats.classes[0].untouched != 0) {
+        printf("........Failed");
+        return 0;
+    }
+
+    printf("........Passed");
+
+    printf("\n2. Testing if frees, failures and the counters of exited\n"
+            "   threads are kept ");
+
+    for (size_t i = 0; i < 513; i++) {
+        pool_free(counted[i]);
+    }
+
+    pthread_t counted_thread;
+    pthread_create(&counted_thread, NULL, take_large_blocks, NULL);
+    pthread_join(counted_thread, NULL);
+
+    // the thread gave back all 13 blocks of 1238 bytes, the 14th fails
+    for (size_t i = 0; i < 14; i++) {
+        counted[i] = pool_malloc(1238);
+    }
+
+    pool_get_stats(&stats);
+    if (stats.classes[0].frees != 512 || stats.classes[0].live != 0 ||
+        stats.classes[0].drawn_peak != 512 || stats.classes[3].allocs != 26 ||
+        stats.classes[3].frees != 13 || stats.classes[3].failed != 1 ||
+        stats.classes[3].block_size != 1240) {
+        printf("........Failed");
+        return 0;
+    }
+
+    printf("........Passed");
+
+    printf("\n3. Testing if requested sizes and wasted bytes are counted ");
+
+    if (!pool_init(test2, 4)) {
+        printf("........Failed");
+        return 0;
+    }
+
+    // 34 bytes from 64 byte blocks twice, 200 from 552 and 5000 from none
+    volatile size_t requested_size = 200;
+    pool_malloc(34);
+    pool_malloc(34);
+    pool_malloc(requested_size);
+    pool_malloc(5000);
+
+    pool_get_stats(&stats);
+    if (stats.classes[1].requested != 68 || stats.classes[1].wasted != 60 ||
+        stats.classes[2].wasted != 352 ||
+        stats.histogram[pool_hist_bucket(34)] != 2 ||
+        stats.histogram[pool_hist_bucket(200)] != 1 ||
+        stats.histogram[pool_hist_bucket(5000)] != 1 ||
+        pool_hist_bucket_size(pool_hist_bucket(5000)) != 5120) {
+        printf("........Failed");
+        return 0;
+    }
+
+    FILE *dump = tmpfile();
+    pool_dump_stats(dump);
+    if (ftell(dump) == 0) {
+        printf("........Failed");
+        return 0;
+    }
+    fclose(dump);
+
+    printf("........Passed");
+    printf("\n");
+    printf("\n");
+
+    printf("Testing size class tuning:\n");
+
+
+    printf("\n1. Testing if the block sizes waste the fewest bytes ");
+
+    static uint64_t histogram[POOL_HIST_BUCKETS];
+    size_t tuned_sizes[64], tuned_weights[64];
+
+    histogram[pool_hist_bucket(24)] = 100;
+    histogram[pool_hist_bucket(40)] = 50;
+    histogram[pool_hist_bucket(100)] = 10;
+    histogram[pool_hist_bucket(200)] = 1;
+    histogram[pool_hist_bucket(1000)] = 5;
+
+    // every size gets its own block size when there are enough of them
+    if (pool_tune(histogram, 64, 65536, tuned_sizes, tuned_weights) != 5 ||
+        tuned_sizes[0] != 24 || tuned_sizes[2] != 104 ||
+        tuned_sizes[4] != 1000) {
+        printf("........Failed");
+        return 0;
+    }
+
+    // 200 byte requests waste 800 bytes in blocks of 1000, less than
+    // 100 byte requests would in blocks of 200
+    if (pool_tune(histogram, 3, 65536, tuned_sizes, tuned_weights) != 3 ||
+        tuned_sizes[0] != 40 || tuned_sizes[1] != 104 ||
+        tuned_sizes[2] != 1000) {
+        printf("........Failed");
+        return 0;
+    }
+
+    printf("........Passed");
+
+    printf("\n2. Testing if the weights split the heap and can be passed\n"
+            "   to pool_init_weighted ");
+
+    // 256 pages of 256 bytes in the 64 KB heap
+    if (tuned_weights[0] + tuned_weights[1] + tuned_weights[2] != 256 ||
+        tuned_weights[2] < 4 ||
+        !pool_init_weighted(tuned_sizes, tuned_weights, 3) ||
+        pool_usable_size(pool_malloc(990)) != 1000) {
+        printf("........Failed");
+        return 0;
+    }
+
+    // a heap of two 256 byte pages only has room for two pools, and
+    // none of them can have blocks of 1000 bytes
+    if (pool_tune(histogram, 3, 512, tuned_sizes, tuned_weights) != 2 ||
+        tuned_sizes[0] != 40 || tuned_sizes[1] != 200) {
+        printf("........Failed");
+        return 0;
+    }
+
+    printf("........Passed");
+    printf("\n");
+    printf("\n");
+
+    printf("Testing eager pools:\n");
+
+
+    printf("\n1. Testing if every block is handed out before a spill ");
+
+    if (!pool_init_eager(test2, NULL, 4)) {
+        printf("........Failed");
+        return 0;
+    }
+
+    // 16384/32 is 512 again, and all of them were threaded up front
+    pool_get_stats(&stats);
+    if (stats.classes[0].carved != 512 || stats.classes[0].untouched != 0) {
+        printf("........Failed");
+        return 0;
+    }
+    for (size_t i = 0; i < 512; i++) {
+        counted[i] = pool_malloc(32);
+        if (pool_usable_size(counted[i]) != 32 ||
+            (i > 0 && counted[i] == counted[i-1])) {
+            printf("........Failed");
+            return 0;
+        }
+        memset(counted[i], 0xff, 32);
+    }
+    counted[512] = pool_malloc(32);
+    if (pool_usable_size(counted[512]) != 64) {
+        printf("........Failed");
+        return 0;
+    }
+
+    printf("........Passed");
+
+    printf("\n2. Testing if freed blocks are reused and calloc zeroes them ");
+
+    for (size_t i = 0; i < 513; i++) {
+        pool_free(counted[i]);
+    }
+    pool_thread_cache_flush();
+
+    for (size_t i = 0; i < 512; i++) {
+        uint64_t *zeroed = pool_calloc(4, 8);
+        if (pool_usable_size(zeroed) != 32 || zeroed[0] != 0 ||
+            zeroed[3] != 0) {
+            printf("........Failed");
+            return 0;
+        }
+    }
+
+    printf("........Passed");
+
+    printf("\n3. Testing if a growable instance threads the memory it\n"
+            "   grows into ");
+
+    ctx1 = pool_create_growable(test3, 2, (size_t) 64 << 20);
+    if (ctx1 == NULL || !pool_ctx_init_eager(ctx1, test3, NULL, 2)) {
+        printf("........Failed");
+        return 0;
+    }
+
+    // 27060 like the growable instance above
+    for (int i= 0; i<27060; i++) {
+
+        int *next = pool_ctx_malloc(ctx1, 1238);
+        if (next == NULL) {
+            printf("........Failed");
+            return 0;
+        }
+        *next = i;
+    }
+
+    if (pool_ctx_malloc(ctx1, 1238) != NULL) {
+        printf("........Failed");
+        return 0;
+    }
+
+    pool_destroy(ctx1);
+
+    printf("........Passed");
+    printf("\n");
+    printf("\n");
+
+#ifdef POOL_TRACE
+    printf("Testing tracing:\n");
+
+
+    printf("\n1. Testing if calls are written to the trace file ");
+
+    if (!pool_init(test2, 4)) {
+        printf("........Failed");
+        return 0;
+    }
+
+    volatile size_t traced_size = 33;
+    pool_free(pool_malloc(traced_size));
+    pool_trace_flush();
+
+    const char *trace_path = getenv("POOL_TRACE_FILE");
+    FILE *trace = fopen(trace_path != NULL ? trace_path : "pool_trace.bin",
+                        "rb");
+    pool_trace_header_t trace_header;
+    pool_trace_record_t record;
+    uint32_t traced_offset = POOL_TRACE_NULL;
+    bool traced_free = false;
+
+    if (trace == NULL || fread(&trace_header, sizeof(trace_header), 1,
+                               trace) != 1 ||
+        memcmp(trace_header.magic, POOL_TRACE_MAGIC, 8) != 0) {
+        printf("........Failed");
+        return 0;
+    }
+    while (fread(&record, sizeof(record), 1, trace) == 1) {
+        if (record.op == POOL_TRACE_MALLOC && record.size == 33) {
+            traced_offset = record.offset;
+            traced_free = false;
+        }
+        else if (record.op == POOL_TRACE_FREE &&
+                 record.offset == traced_offset) {
+            traced_free = true;
+        }
+    }
+    fclose(trace);
+
+    if (traced_offset == POOL_TRACE_NULL || !traced_free) {
+        printf("........Failed");
+        return 0;
+    }
+
+    printf("........Passed");
+    printf("\n");
+    printf("\n");
+#endif
+
     printf("All test passed!\n");
 
 
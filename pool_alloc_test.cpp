@@ -0,0 +1,199 @@
+#include <cstdio>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include <memory_resource>
+#include "pool_alloc.hpp"
+#include "pool_fixed.hpp"
+
+
+struct Node {
+    Node* next;
+    long value[3];
+};
+
+
+int main() {
+
+    size_t test_sizes[4] = {24, 48, 64, 128};
+
+    printf("Testing PoolAllocator:\n");
+
+
+    printf("\n1. Testing if list nodes come from the pools ");
+
+    if (!pool_init(test_sizes, 4)) {
+        printf("........Failed");
+        return 0;
+    }
+
+    std::list<int, pool::PoolAllocator<int>> nodes;
+    for (int i= 0; i<100; i++) {
+        nodes.push_back(i);
+    }
+
+    int expected = 0;
+    for (int& value : nodes) {
+
+        if (value != expected++ || !pool_owns(&value)) {
+            printf("........Failed");
+            return 0;
+        }
+    }
+
+    printf("........Passed");
+
+    printf("\n2. Testing if maps work and give their nodes back ");
+
+    {
+        std::map<int, int, std::less<int>,
+                 pool::PoolAllocator<std::pair<const int, int>>> tree;
+        std::unordered_map<int, int, std::hash<int>, std::equal_to<int>,
+                           pool::PoolAllocator<std::pair<const int, int>>>
+            table;
+        for (int i= 0; i<200; i++) {
+            tree[i] = i;
+            table[i] = i;
+        }
+
+        for (int i= 0; i<200; i++) {
+
+            if (tree[i] != i || table[i] != i) {
+                printf("........Failed");
+                return 0;
+            }
+        }
+    }
+    pool_thread_cache_flush();
+
+    // map nodes are 48 bytes, and 341 since 16384/48 is 341
+    std::vector<void*> blocks;
+    for (int i= 0; i<341; i++) {
+
+        void* block = pool_malloc(48);
+        if (pool_usable_size(block) != 48) {
+            printf("........Failed");
+            return 0;
+        }
+        blocks.push_back(block);
+    }
+
+    for (void* block : blocks) {
+        pool_free(block);
+    }
+
+    printf("........Passed");
+
+    printf("\n3. Testing if requests the pools can't serve fall back\n"
+            "   to operator new ");
+
+    std::vector<int, pool::PoolAllocator<int>> large(1000, 7);
+    if (pool_owns(large.data()) || large[999] != 7) {
+        printf("........Failed");
+        return 0;
+    }
+
+    printf("........Passed");
+    printf("\n");
+    printf("\n");
+
+    printf("Testing PoolResource:\n");
+
+
+    printf("\n1. Testing if pmr containers use the pools ");
+
+    std::pmr::list<long> pmr_nodes(pool::resource());
+    for (long i= 0; i<100; i++) {
+        pmr_nodes.push_front(i);
+    }
+
+    if (!pool_owns(&pmr_nodes.front()) || pmr_nodes.front() != 99) {
+        printf("........Failed");
+        return 0;
+    }
+
+    printf("........Passed");
+
+    printf("\n2. Testing if aligned and large requests are served ");
+
+    void* aligned = pool::resource()->allocate(64, 64);
+    void* big = pool::resource()->allocate(4096, 16);
+    if ((uintptr_t) aligned % 64 != 0 || !pool_owns(aligned) ||
+        pool_owns(big)) {
+        printf("........Failed");
+        return 0;
+    }
+    pool::resource()->deallocate(aligned, 64, 64);
+    pool::resource()->deallocate(big, 4096, 16);
+
+    pool::PoolResource other;
+    if (!pool::resource()->is_equal(other) ||
+        pool::resource()->is_equal(*std::pmr::new_delete_resource())) {
+        printf("........Failed");
+        return 0;
+    }
+
+    printf("........Passed");
+    printf("\n");
+    printf("\n");
+
+    printf("Testing fixed PoolAllocator:\n");
+
+
+    printf("\n1. Testing if the pools are laid out at compile time ");
+
+    using Fixed = pool::fixed::PoolAllocator<1238, 32, 547, 64>;
+
+    static_assert(Fixed::block_sizes[0] == 32 &&
+                  Fixed::block_sizes[3] == 1240, "sizes are sorted");
+    static_assert(Fixed::size_class(sizeof(Node)) == 0, "Node fits 32");
+    static_assert(Fixed::capacity(3) == 13, "16384/1240 is 13");
+    static_assert(Fixed::pool_offset(2) == 32768, "pools are 16 KB");
+
+    printf("........Passed");
+
+    printf("\n2. Testing if a pool runs out and then spills ");
+
+    static Fixed fixed;
+
+    // 512 since 16384/32 is 512
+    for (int i= 0; i<512; i++) {
+
+        if (fixed.malloc<sizeof(Node)>() == nullptr) {
+            printf("........Failed");
+            return 0;
+        }
+    }
+
+    void* spilled = fixed.malloc<sizeof(Node)>();
+    if (spilled == nullptr || fixed.malloc(5000) != nullptr) {
+        printf("........Failed");
+        return 0;
+    }
+
+    printf("........Passed");
+
+    printf("\n3. Testing if freed blocks go back to their own pool ");
+
+    fixed.free<sizeof(Node)>(spilled);
+    if (fixed.malloc<64>() != spilled) {
+        printf("........Failed");
+        return 0;
+    }
+
+    void* block = fixed.malloc(1000);
+    fixed.free(static_cast<char*>(block) + 8);
+    fixed.free(block);
+    if (!fixed.owns(block) || fixed.malloc<1238>() != block) {
+        printf("........Failed");
+        return 0;
+    }
+
+    printf("........Passed");
+    printf("\n");
+    printf("\n");
+
+    printf("All test passed!\n");
+}
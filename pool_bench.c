@@ -0,0 +1,628 @@
+/*
+ * @file pool_bench.c
+ * @brief latency microbenchmarks for the tunable pool allocator
+ *
+ *
+ * Times every pool_malloc and pool_free of a set of allocation patterns
+ * in CPU cycles, read with rdtsc before the call and rdtscp after it, and
+ * prints the p50, p99, p99.9 and max latencies of each as JSON. On CPUs
+ * other than x86 the times are in nanoseconds instead.
+ *
+ * The patterns are:
+ * ~ lifo: 64 objects of 64 bytes allocated and freed in reverse order,
+ *   with a constant size so that pool_malloc is the inline fast path
+ * ~ fifo: a queue of 1024 objects of 64 bytes, freeing the oldest for
+ *   every new one
+ * ~ random: 4096 objects of 64 bytes freed in random order
+ * ~ mixed: 1024 slots of objects of random sizes from 16 to 1024 bytes,
+ *   each step freeing a random slot and allocating a new size into it
+ * ~ exhaustion: the 64 KB heap filled with 64 byte objects until
+ *   pool_malloc fails, through spills into larger pools, then freed
+ *
+ * Every pattern runs once untimed to warm the caches up first, and the
+ * benchmark is pinned to one CPU so the cycle counter doesn't change
+ * under it. The cost of reading the counter is measured and taken off.
+ *
+ * After it is timed, every pattern is set up and warmed up again and
+ * runs once more between reads of the hardware counters of
+ * perf_event_open and of the wall clock, without timing each call, for
+ * the nanoseconds, instructions, cycles, L1 data cache, last level cache
+ * and data TLB read misses and branch mispredicts per allocation (a
+ * malloc that succeeded and its free, whether the first run timed it or
+ * not). Counters the CPU or the kernel doesn't provide, as in most
+ * virtual machines or with a kernel.perf_event_paranoid above 2, are
+ * null.
+ *
+ * Usage: pool_bench [-c cpu] [-n rounds] [-p pattern] [-e]
+ * ~ -c: the CPU to pin to, the one it starts on by default
+ * ~ -n: rounds of each pattern, 1000 by default
+ * ~ -p: run only this pattern
+ * ~ -e: set the heap of the exhaustion pattern up with pool_init_eager
+ *
+ * @author Akash Arun <akasha@andrew.cmu.edu>
+*/
+
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#define POOL_INLINE
+#include "pool_alloc.h"
+
+
+#define SUB_BITS 5
+#define SUB_BUCKETS (1 << SUB_BITS)
+#define HIST_BUCKETS (2*SUB_BUCKETS + (63 - SUB_BITS)*SUB_BUCKETS)
+#define DEFAULT_ROUNDS 1000
+#define LIFO_DEPTH 64
+#define FIFO_DEPTH 1024
+#define RANDOM_COUNT 4096
+#define MIXED_SLOTS 1024
+#define MAX_OBJECTS 4096
+#define GROWABLE_RESERVE ((size_t) 1 << 30)
+#define NUM_COUNTERS 6
+#define CACHE_MISSES(cache) ((cache) | \
+    (PERF_COUNT_HW_CACHE_OP_READ << 8) | \
+    (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+
+/* Data Structures:
+ *
+ * hist_t is an HDR style histogram of latencies: values below
+ * 2*SUB_BUCKETS have a bucket each, and every power of two above is
+ * split into SUB_BUCKETS buckets, so a percentile is within about 3% of
+ * the latency it stands for.
+ *
+ * pattern_t is a benchmark, run for a number of rounds, timing its
+ * mallocs into one histogram and its frees into another, and returning
+ * how many of its mallocs succeeded, timed or not. The histograms are
+ * NULL for the runs that aren't timed.
+ *
+ * counter_t is a hardware counter, with the file descriptor
+ * perf_event_open gave it or -1 if it isn't available.
+ *
+ * counts_t holds the counters of the run of a pattern, scaled up if
+ * the kernel had to share the hardware between them, with the
+ * allocations that succeeded and the wall clock time of the run.
+*/
+
+typedef struct hist {
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t total;
+    uint64_t sum;
+    uint64_t max;
+} hist_t;
+
+typedef struct pattern {
+    const char *name;
+    void (*setup)(void);
+    size_t (*run)(hist_t *mallocs, hist_t *frees, size_t rounds);
+} pattern_t;
+
+typedef struct counter {
+    const char *name;
+    uint32_t type;
+    uint64_t config;
+    int fd;
+} counter_t;
+
+typedef struct counts {
+    uint64_t values[NUM_COUNTERS];
+    bool valid[NUM_COUNTERS];
+    uint64_t allocations;
+    uint64_t ns;
+} counts_t;
+
+
+/* Global Variables:
+ * overhead is the cost of reading the counter, taken off every latency
+ * objects and sizes hold the objects of a pattern and their sizes
+ * rng is the state of the random number generator
+ * eager is whether the exhaustion pattern threads its pools up front
+ * counters are the hardware counters read around the counted runs
+*/
+
+static uint64_t overhead;
+static void *objects[MAX_OBJECTS];
+static size_t sizes[MAX_OBJECTS];
+static uint64_t rng = 0x2545f4914f6cdd1dULL;
+static bool eager;
+static counter_t counters[NUM_COUNTERS] = {
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, -1},
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1},
+    {"l1d_misses", PERF_TYPE_HW_CACHE,
+     CACHE_MISSES(PERF_COUNT_HW_CACHE_L1D), -1},
+    {"llc_misses", PERF_TYPE_HW_CACHE,
+     CACHE_MISSES(PERF_COUNT_HW_CACHE_LL), -1},
+    {"dtlb_misses", PERF_TYPE_HW_CACHE,
+     CACHE_MISSES(PERF_COUNT_HW_CACHE_DTLB), -1},
+    {"branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, -1}
+};
+
+
+/* Helper Functions: */
+
+
+#if defined(__x86_64__) || defined(__i386__)
+#define TIME_UNIT "cycles"
+
+// fenced, so the call being timed can't start before the counter is read
+static inline uint64_t timer_begin(void)
+{
+    _mm_lfence();
+    uint64_t now = __rdtsc();
+    _mm_lfence();
+    return now;
+}
+
+// rdtscp waits for the call to finish before reading the counter
+static inline uint64_t timer_end(void)
+{
+    unsigned int cpu;
+    uint64_t now = __rdtscp(&cpu);
+    _mm_lfence();
+    return now;
+}
+#else
+#define TIME_UNIT "ns"
+
+static inline uint64_t timer_begin(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static inline uint64_t timer_end(void)
+{
+    return timer_begin();
+}
+#endif
+
+// wall clock time in nanoseconds, for the runs that aren't timed per call
+static uint64_t now_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static inline uint64_t next_random(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+static size_t hist_bucket(uint64_t value)
+{
+    if (value < 2*SUB_BUCKETS) {
+        return value;
+    }
+
+    size_t msb = 63 - __builtin_clzll(value);
+    size_t shift = msb - SUB_BITS;
+    return 2*SUB_BUCKETS + (msb - SUB_BITS - 1)*SUB_BUCKETS +
+        ((value >> shift) - SUB_BUCKETS);
+}
+
+// the largest latency counted by a bucket
+static uint64_t hist_value(size_t bucket)
+{
+    if (bucket < 2*SUB_BUCKETS) {
+        return bucket;
+    }
+
+    size_t k = bucket - 2*SUB_BUCKETS;
+    size_t shift = k/SUB_BUCKETS + 1;
+    return ((uint64_t) (k%SUB_BUCKETS + SUB_BUCKETS + 1) << shift) - 1;
+}
+
+static inline void hist_add(hist_t *hist, uint64_t start, uint64_t end)
+{
+    uint64_t value = end - start;
+
+    value = value > overhead ? value - overhead : 0;
+    hist->counts[hist_bucket(value)]++;
+    hist->total++;
+    hist->sum += value;
+    if (value > hist->max) {
+        hist->max = value;
+    }
+}
+
+/* @brief finds a percentile of the latencies of a histogram
+ *
+ * param[in] hist: the histogram
+ * param[in] percent: the percentile, from 0 to 100
+ *
+ * returns the latency, at most the largest one counted
+*/
+
+static uint64_t hist_percentile(const hist_t *hist, double percent)
+{
+    uint64_t rank = (uint64_t) (hist->total * percent / 100.0);
+    uint64_t seen = 0;
+
+    if (rank >= hist->total) {
+        return hist->max;
+    }
+    for (size_t b = 0; b < HIST_BUCKETS; b++) {
+        seen += hist->counts[b];
+        if (seen > rank) {
+            uint64_t value = hist_value(b);
+            return value < hist->max ? value : hist->max;
+        }
+    }
+    return hist->max;
+}
+
+// the least time between two reads of the counter
+static uint64_t measure_overhead(void)
+{
+    uint64_t least = UINT64_MAX;
+
+    for (size_t k = 0; k < 100000; k++) {
+        uint64_t start = timer_begin();
+        uint64_t end = timer_end();
+        if (end - start < least) {
+            least = end - start;
+        }
+    }
+    return least;
+}
+
+// calls that aren't timed don't read the counter, so the hardware
+// counters only see the allocator
+#define TIMED(hist, call) \
+    do { \
+        if ((hist) == NULL) { \
+            call; \
+        } \
+        else { \
+            uint64_t start_ = timer_begin(); \
+            call; \
+            hist_add(hist, start_, timer_end()); \
+        } \
+    } while (0)
+
+// opens the counters of this thread in user space, disabled
+static void counters_open(void)
+{
+    struct perf_event_attr attr;
+
+    for (size_t c = 0; c < NUM_COUNTERS; c++) {
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = counters[c].type;
+        attr.config = counters[c].config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+            PERF_FORMAT_TOTAL_TIME_RUNNING;
+        counters[c].fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+}
+
+static void counters_start(void)
+{
+    for (size_t c = 0; c < NUM_COUNTERS; c++) {
+        if (counters[c].fd >= 0) {
+            ioctl(counters[c].fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(counters[c].fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+/* @brief stops the counters and reads them into counts
+ *
+ * The kernel multiplexes counters when the CPU has fewer than are open,
+ * so each is scaled by the time it was enabled over the time it ran.
+ * Counters that didn't run at all are left invalid.
+*/
+
+static void counters_stop(counts_t *counts)
+{
+    for (size_t c = 0; c < NUM_COUNTERS; c++) {
+        if (counters[c].fd >= 0) {
+            ioctl(counters[c].fd, PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+
+    for (size_t c = 0; c < NUM_COUNTERS; c++) {
+        uint64_t read_values[3];
+
+        counts->valid[c] = false;
+        if (counters[c].fd < 0 ||
+            read(counters[c].fd, read_values, sizeof(read_values)) !=
+            sizeof(read_values) || read_values[2] == 0) {
+            continue;
+        }
+        counts->values[c] = (uint64_t) ((double) read_values[0] *
+                                         read_values[1] / read_values[2]);
+        counts->valid[c] = true;
+    }
+}
+
+
+/* Patterns: */
+
+
+// jemalloc style sizes on a heap large enough not to run out
+static void growable_setup(void)
+{
+    size_t block_sizes[POOL_MAX_NUM_POOLS];
+    size_t count = pool_geometric_sizes(16, 1024, 4, block_sizes);
+
+    if (!pool_init_growable(block_sizes, count, GROWABLE_RESERVE)) {
+        fprintf(stderr, "pool_bench: pool_init_growable failed\n");
+        exit(1);
+    }
+}
+
+static void exhaustion_setup(void)
+{
+    size_t block_sizes[3] = {64, 128, 256};
+
+    if (!(eager ? pool_init_eager(block_sizes, NULL, 3) :
+          pool_init(block_sizes, 3))) {
+        fprintf(stderr, "pool_bench: pool_init failed\n");
+        exit(1);
+    }
+}
+
+static size_t run_lifo(hist_t *mallocs, hist_t *frees, size_t rounds)
+{
+    for (size_t round = 0; round < rounds; round++) {
+        for (size_t k = 0; k < LIFO_DEPTH; k++) {
+            TIMED(mallocs, objects[k] = pool_malloc(64));
+        }
+        for (size_t k = LIFO_DEPTH; k > 0; k--) {
+            TIMED(frees, pool_free(objects[k-1]));
+        }
+    }
+    return rounds * LIFO_DEPTH;
+}
+
+static size_t run_fifo(hist_t *mallocs, hist_t *frees, size_t rounds)
+{
+    volatile size_t size = 64;
+
+    for (size_t k = 0; k < FIFO_DEPTH; k++) {
+        objects[k] = pool_malloc(size);
+    }
+    for (size_t round = 0; round < rounds; round++) {
+        for (size_t k = 0; k < FIFO_DEPTH; k++) {
+            TIMED(frees, pool_free(objects[k]));
+            TIMED(mallocs, objects[k] = pool_malloc(size));
+        }
+    }
+    for (size_t k = 0; k < FIFO_DEPTH; k++) {
+        pool_free(objects[k]);
+    }
+    return (rounds + 1) * FIFO_DEPTH;
+}
+
+static size_t run_random(hist_t *mallocs, hist_t *frees, size_t rounds)
+{
+    volatile size_t size = 64;
+
+    for (size_t round = 0; round < rounds/16 + 1; round++) {
+        for (size_t k = 0; k < RANDOM_COUNT; k++) {
+            TIMED(mallocs, objects[k] = pool_malloc(size));
+        }
+        // Fisher-Yates, so every object is freed once in random order
+        for (size_t k = RANDOM_COUNT - 1; k > 0; k--) {
+            size_t other = next_random() % (k + 1);
+            void *swap = objects[k];
+            objects[k] = objects[other];
+            objects[other] = swap;
+        }
+        for (size_t k = 0; k < RANDOM_COUNT; k++) {
+            TIMED(frees, pool_free(objects[k]));
+        }
+    }
+    return (rounds/16 + 1) * RANDOM_COUNT;
+}
+
+static size_t run_mixed(hist_t *mallocs, hist_t *frees, size_t rounds)
+{
+    for (size_t k = 0; k < MIXED_SLOTS; k++) {
+        sizes[k] = 16 + next_random() % 1009;
+        objects[k] = pool_malloc(sizes[k]);
+    }
+    for (size_t step = 0; step < rounds * MIXED_SLOTS; step++) {
+        size_t k = next_random() % MIXED_SLOTS;
+        size_t size = 16 + next_random() % 1009;
+
+        TIMED(frees, pool_free(objects[k]));
+        TIMED(mallocs, objects[k] = pool_malloc(size));
+    }
+    for (size_t k = 0; k < MIXED_SLOTS; k++) {
+        pool_free(objects[k]);
+    }
+    return (rounds + 1) * MIXED_SLOTS;
+}
+
+static size_t run_exhaustion(hist_t *mallocs, hist_t *frees, size_t rounds)
+{
+    volatile size_t size = 64;
+    size_t allocations = 0;
+
+    for (size_t round = 0; round < rounds/16 + 1; round++) {
+        size_t count = 0;
+        void *ptr;
+
+        // the last call is the one that fails
+        do {
+            TIMED(mallocs, ptr = pool_malloc(size));
+            objects[count] = ptr;
+        } while (ptr != NULL && ++count < MAX_OBJECTS);
+
+        for (size_t k = 0; k < count; k++) {
+            TIMED(frees, pool_free(objects[k]));
+        }
+        pool_thread_cache_flush();
+        allocations += count;
+    }
+    return allocations;
+}
+
+static const pattern_t patterns[] = {
+    {"lifo", growable_setup, run_lifo},
+    {"fifo", growable_setup, run_fifo},
+    {"random", growable_setup, run_random},
+    {"mixed", growable_setup, run_mixed},
+    {"exhaustion", exhaustion_setup, run_exhaustion}
+};
+
+
+/* @brief prints the latencies of one kind of call of a pattern as a
+ * JSON object
+ *
+ * param[in] first: whether it is the first object of the results
+*/
+
+static void print_result(const char *pattern, const char *op,
+                         const hist_t *hist, bool first)
+{
+    printf("%s    {\"pattern\": \"%s\", \"op\": \"%s\", \"count\": %llu, "
+           "\"mean\": %.1f, \"p50\": %llu, \"p99\": %llu, "
+           "\"p99.9\": %llu, \"max\": %llu}", first ? "" : ",\n",
+           pattern, op,
+           (unsigned long long) hist->total,
+           hist->total != 0 ? (double) hist->sum / hist->total : 0.0,
+           (unsigned long long) hist_percentile(hist, 50),
+           (unsigned long long) hist_percentile(hist, 99),
+           (unsigned long long) hist_percentile(hist, 99.9),
+           (unsigned long long) hist->max);
+}
+
+/* @brief prints the hardware counters of a pattern per allocation as a
+ * JSON object
+ *
+ * param[in] first: whether it is the first object of the counters
+*/
+
+static void print_counts(const char *pattern, const counts_t *counts,
+                         bool first)
+{
+    printf("%s    {\"pattern\": \"%s\", \"allocations\": %llu, "
+           "\"ns\": %llu, \"ns_per_allocation\": %.3f",
+           first ? "" : ",\n", pattern,
+           (unsigned long long) counts->allocations,
+           (unsigned long long) counts->ns,
+           counts->allocations != 0 ?
+           (double) counts->ns / counts->allocations : 0.0);
+    for (size_t c = 0; c < NUM_COUNTERS; c++) {
+        if (!counts->valid[c] || counts->allocations == 0) {
+            printf(", \"%s\": null", counters[c].name);
+        }
+        else {
+            printf(", \"%s\": %.3f", counters[c].name,
+                   (double) counts->values[c] / counts->allocations);
+        }
+    }
+    printf("}");
+}
+
+
+int main(int argc, char **argv)
+{
+    static hist_t mallocs, frees;
+    size_t num_patterns = sizeof(patterns)/sizeof(patterns[0]);
+    counts_t counts[sizeof(patterns)/sizeof(patterns[0])];
+    bool ran[sizeof(patterns)/sizeof(patterns[0])] = {false};
+    size_t rounds = DEFAULT_ROUNDS;
+    const char *only = NULL;
+    int cpu = sched_getcpu(), opt;
+    bool first = true;
+    cpu_set_t set;
+
+    while ((opt = getopt(argc, argv, "c:n:p:e")) != -1) {
+        if (opt == 'c') {
+            cpu = atoi(optarg);
+        }
+        else if (opt == 'n') {
+            rounds = strtoull(optarg, NULL, 10);
+        }
+        else if (opt == 'p') {
+            only = optarg;
+        }
+        else if (opt == 'e') {
+            eager = true;
+        }
+        else {
+            fprintf(stderr, "usage: %s [-c cpu] [-n rounds] [-p pattern] "
+                    "[-e]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+        perror("sched_setaffinity");
+        return 1;
+    }
+    overhead = measure_overhead();
+    counters_open();
+
+    printf("{\n  \"unit\": \"%s\",\n  \"timer_overhead\": %llu,\n"
+           "  \"cpu\": %d,\n  \"rounds\": %zu,\n  \"results\": [\n",
+           TIME_UNIT, (unsigned long long) overhead, cpu, rounds);
+    for (size_t p = 0; p < num_patterns; p++) {
+        if (only != NULL && strcmp(only, patterns[p].name) != 0) {
+            continue;
+        }
+
+        patterns[p].setup();
+        patterns[p].run(NULL, NULL, rounds/10 + 1);
+
+        memset(&mallocs, 0, sizeof(mallocs));
+        memset(&frees, 0, sizeof(frees));
+        patterns[p].run(&mallocs, &frees, rounds);
+
+        // the same rounds again, timed as a whole, on a heap warmed up
+        // like the one the latencies came from
+        patterns[p].setup();
+        patterns[p].run(NULL, NULL, rounds/10 + 1);
+        counters_start();
+        uint64_t start = now_ns();
+        counts[p].allocations = patterns[p].run(NULL, NULL, rounds);
+        counts[p].ns = now_ns() - start;
+        counters_stop(&counts[p]);
+        ran[p] = true;
+
+        print_result(patterns[p].name, "malloc", &mallocs, first);
+        print_result(patterns[p].name, "free", &frees, false);
+        first = false;
+    }
+
+    printf("\n  ],\n  \"counters\": [\n");
+    first = true;
+    for (size_t p = 0; p < num_patterns; p++) {
+        if (ran[p]) {
+            print_counts(patterns[p].name, &counts[p], first);
+            first = false;
+        }
+    }
+    printf("\n  ]\n}\n");
+    return 0;
+}
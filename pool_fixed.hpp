@@ -0,0 +1,256 @@
+/*
+ * @file pool_fixed.hpp
+ * @brief tunable pool allocator with block sizes fixed at compile time
+ *
+ *
+ * pool::fixed::BasicPoolAllocator<HeapSize, Sizes...> is a header-only
+ * version of the pool allocator for programs that know their block sizes
+ * when they are compiled. The sizes are rounded up to a multiple of 8
+ * and sorted, and the heap is split into equally sized pools like
+ * pool_init does, but all of it is computed by the compiler: the size
+ * class of every size, the offset of every pool and the number of
+ * blocks it holds. malloc<sizeof(T)>() picks its pool at compile time
+ * and comes down to popping a free list, or carving the next block of
+ * the pool if nothing was freed yet.
+ *
+ * Configurations pool_init would reject fail to compile instead:
+ * ~ no block sizes or more than 64
+ * ~ a block size smaller than a pointer
+ * ~ a pool too small for one of its blocks
+ *
+ * An allocator owns its heap and isn't thread safe, so each thread or
+ * worker should have one of its own.
+ *
+ * @author Akash Arun <akasha@andrew.cmu.edu>
+*/
+
+#ifndef POOL_FIXED_HPP
+#define POOL_FIXED_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace pool {
+namespace fixed {
+
+constexpr std::size_t max_num_pools = 64;
+constexpr std::size_t heap_align = 64;
+
+/* @brief rounds block sizes up to a multiple of 8 and sorts them
+*/
+
+template <std::size_t Count>
+constexpr std::array<std::size_t, Count>
+sorted_sizes(std::array<std::size_t, Count> sizes)
+{
+    for (std::size_t i = 0; i < Count; i++) {
+        sizes[i] = (sizes[i] + 7) & ~std::size_t(7);
+    }
+    for (std::size_t i = 1; i < Count; i++) {
+        std::size_t size = sizes[i];
+        std::size_t j = i;
+        for (; j > 0 && sizes[j-1] > size; j--) {
+            sizes[j] = sizes[j-1];
+        }
+        sizes[j] = size;
+    }
+    return sizes;
+}
+
+template <std::size_t HeapSize, std::size_t... Sizes>
+class BasicPoolAllocator {
+public:
+    static constexpr std::size_t num_pools = sizeof...(Sizes);
+
+    static_assert(num_pools >= 1 && num_pools <= max_num_pools,
+                  "between 1 and 64 block sizes are needed");
+    static_assert(((Sizes >= sizeof(void*)) && ...),
+                  "blocks must be large enough to hold a pointer");
+
+    // the sorted block sizes, and the bytes of the heap each pool gets,
+    // a multiple of heap_align so every pool starts aligned
+    static constexpr std::array<std::size_t, num_pools> block_sizes =
+        sorted_sizes<num_pools>({Sizes...});
+    static constexpr std::size_t pool_size =
+        HeapSize / num_pools / heap_align * heap_align;
+
+    static_assert(pool_size >= block_sizes[num_pools-1],
+                  "every pool must hold at least one block");
+
+    /* @brief finds the pool with the smallest blocks that fit n
+     *
+     * returns the index of the pool, or num_pools if none fits n
+    */
+
+    static constexpr std::size_t size_class(std::size_t n)
+    {
+        std::size_t i = 0;
+        while (i < num_pools && block_sizes[i] < n) {
+            i++;
+        }
+        return i;
+    }
+
+    // the number of blocks pool i holds, and its offset into the heap
+    static constexpr std::size_t capacity(std::size_t i)
+    {
+        return pool_size / block_sizes[i];
+    }
+
+    static constexpr std::size_t pool_offset(std::size_t i)
+    {
+        return i * pool_size;
+    }
+
+    BasicPoolAllocator() noexcept
+    {
+        for (std::size_t i = 0; i < num_pools; i++) {
+            free_[i] = nullptr;
+            carve_[i] = heap_ + pool_offset(i);
+        }
+    }
+
+    BasicPoolAllocator(const BasicPoolAllocator&) = delete;
+    BasicPoolAllocator& operator=(const BasicPoolAllocator&) = delete;
+
+    /* @brief allocates an object of N bytes, spilling into the pools of
+     * larger blocks when its pool is full
+     *
+     * returns the address of the allocated memory or nullptr
+    */
+
+    template <std::size_t N>
+    void* malloc() noexcept
+    {
+        static_assert(N >= 1 && size_class(N) < num_pools,
+                      "no pool has blocks large enough");
+        return take<size_class(N)>();
+    }
+
+    /* @brief frees an object allocated with malloc<N>
+     *
+     * The pool is found from N and confirmed with a comparison against
+     * its range, objects that spilled into a pool of larger blocks are
+     * freed like free(ptr) does.
+    */
+
+    template <std::size_t N>
+    void free(void* ptr) noexcept
+    {
+        constexpr std::size_t i = size_class(N);
+        static_assert(N >= 1 && i < num_pools,
+                      "no pool has blocks large enough");
+
+        std::uint8_t* byte = static_cast<std::uint8_t*>(ptr);
+        if (byte >= heap_ + pool_offset(i) &&
+            byte < heap_ + pool_offset(i) + pool_size) {
+            give(i, ptr);
+        }
+        else {
+            free(ptr);
+        }
+    }
+
+    /* @brief allocates an object of n bytes, for sizes only known at
+     * run time
+     *
+     * returns the address of the allocated memory or nullptr
+    */
+
+    void* malloc(std::size_t n) noexcept
+    {
+        if (n < 1) {
+            return nullptr;
+        }
+        for (std::size_t i = size_class(n); i < num_pools; i++) {
+            void* ptr = take(i);
+            if (ptr != nullptr) {
+                return ptr;
+            }
+        }
+        return nullptr;
+    }
+
+    /* @brief frees an object of any size, ignoring addresses that are
+     * outside the heap or not the start of a block
+    */
+
+    void free(void* ptr) noexcept
+    {
+        std::uintptr_t offset = reinterpret_cast<std::uintptr_t>(ptr) -
+            reinterpret_cast<std::uintptr_t>(heap_);
+        std::size_t i = offset / pool_size;
+
+        if (offset >= num_pools * pool_size) {
+            return;
+        }
+        std::size_t rel = offset - pool_offset(i);
+        if (rel % block_sizes[i] != 0 ||
+            rel / block_sizes[i] >= capacity(i)) {
+            return;
+        }
+        give(i, ptr);
+    }
+
+    // whether ptr points into the heap of this allocator
+    bool owns(const void* ptr) const noexcept
+    {
+        return reinterpret_cast<std::uintptr_t>(ptr) -
+            reinterpret_cast<std::uintptr_t>(heap_) < HeapSize;
+    }
+
+private:
+    struct block {
+        block* next;
+    };
+
+    template <std::size_t I>
+    void* take() noexcept
+    {
+        void* ptr = take(I);
+        if constexpr (I + 1 < num_pools) {
+            if (ptr == nullptr) {
+                return take<I + 1>();
+            }
+        }
+        return ptr;
+    }
+
+    void* take(std::size_t i) noexcept
+    {
+        block* head = free_[i];
+        if (head != nullptr) {
+            free_[i] = head->next;
+            return head;
+        }
+        // blocks that were never allocated are carved in order
+        if (carve_[i] + block_sizes[i] <=
+            heap_ + pool_offset(i) + capacity(i) * block_sizes[i]) {
+            void* ptr = carve_[i];
+            carve_[i] += block_sizes[i];
+            return ptr;
+        }
+        return nullptr;
+    }
+
+    void give(std::size_t i, void* ptr) noexcept
+    {
+        block* freed = static_cast<block*>(ptr);
+        freed->next = free_[i];
+        free_[i] = freed;
+    }
+
+    alignas(heap_align) std::uint8_t heap_[HeapSize];
+    block* free_[num_pools];
+    std::uint8_t* carve_[num_pools];
+};
+
+// A compile time allocator on a 64 KB heap, like the global pools.
+template <std::size_t... Sizes>
+using PoolAllocator = BasicPoolAllocator<65536, Sizes...>;
+
+}  // namespace fixed
+}  // namespace pool
+
+#endif
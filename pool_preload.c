@@ -0,0 +1,280 @@
+/*
+ * @file pool_preload.c
+ * @brief malloc interposition for the tunable pool allocator
+ *
+ *
+ * Built into a shared library together with pool_alloc.c and loaded
+ * with LD_PRELOAD, this file replaces malloc, free, calloc, realloc,
+ * posix_memalign and malloc_usable_size of an unmodified program.
+ * Requests that fit a pool are served by the pool allocator and
+ * everything else is passed to the next allocator, found with
+ * dlsym(RTLD_NEXT). free, realloc and malloc_usable_size tell the two
+ * apart by whether the address is in the pool heap.
+ *
+ * The pools are set up on first use from the environment:
+ * ~ POOL_SIZES: comma separated block sizes, by default jemalloc style
+ *   sizes from 16 to 1024 bytes with 4 per doubling
+ * ~ POOL_RESERVE: bytes of address space the growable pool heap
+ *   reserves, 1 GB by default
+ *
+ * dlsym may itself allocate before the next allocator is known. Those
+ * allocations come from a small static buffer and are never freed.
+ *
+ * @author Akash Arun <akasha@andrew.cmu.edu>
+*/
+
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <pthread.h>
+#include <dlfcn.h>
+#include "pool_alloc.h"
+
+
+#define DEFAULT_RESERVE ((size_t) 1 << 30)
+#define BOOT_SIZE 4096
+
+
+/* Global Variables:
+ * next_* are the functions of the allocator the pools are put in front of
+ * ready is set once they are found and the pools are initialized
+ * in_init is set on the thread finding them, whose allocations go to
+ * boot_buffer meanwhile
+*/
+
+static void *(*next_malloc)(size_t);
+static void (*next_free)(void *);
+static void *(*next_calloc)(size_t, size_t);
+static void *(*next_realloc)(void *, size_t);
+static int (*next_posix_memalign)(void **, size_t, size_t);
+static size_t (*next_malloc_usable_size)(void *);
+
+static bool ready;
+static _Thread_local bool in_init;
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+
+static _Alignas(16) uint8_t boot_buffer[BOOT_SIZE];
+static size_t boot_used;
+
+
+/* Helper Functions: */
+
+
+/* @brief reads the block sizes of the pools from POOL_SIZES
+ *
+ * param[out] block_sizes: the block sizes, room for POOL_MAX_NUM_POOLS
+ *
+ * returns the number of block sizes, 0 if POOL_SIZES is unset or invalid
+*/
+
+static size_t env_sizes(size_t *block_sizes)
+{
+    const char *list = getenv("POOL_SIZES");
+    size_t count = 0;
+
+    if (list == NULL) {
+        return 0;
+    }
+    while (*list != '\0') {
+        char *end;
+        unsigned long size = strtoul(list, &end, 10);
+
+        if (end == list || size == 0 || count == POOL_MAX_NUM_POOLS) {
+            return 0;
+        }
+        block_sizes[count++] = size;
+        list = *end == ',' ? end + 1 : end;
+        if (*end != ',' && *end != '\0') {
+            return 0;
+        }
+    }
+    return count;
+}
+
+/* @brief finds the next allocator and initializes the pools, run once
+ * by the first thread that allocates
+*/
+
+static void shim_init(void)
+{
+    size_t block_sizes[POOL_MAX_NUM_POOLS];
+    size_t block_size_count, reserve = DEFAULT_RESERVE;
+    const char *env;
+
+    in_init = true;
+    next_malloc = dlsym(RTLD_NEXT, "malloc");
+    next_free = dlsym(RTLD_NEXT, "free");
+    next_calloc = dlsym(RTLD_NEXT, "calloc");
+    next_realloc = dlsym(RTLD_NEXT, "realloc");
+    next_posix_memalign = dlsym(RTLD_NEXT, "posix_memalign");
+    next_malloc_usable_size = dlsym(RTLD_NEXT, "malloc_usable_size");
+
+    env = getenv("POOL_RESERVE");
+    if (env != NULL && strtoull(env, NULL, 10) != 0) {
+        reserve = strtoull(env, NULL, 10);
+    }
+    block_size_count = env_sizes(block_sizes);
+    if (block_size_count == 0) {
+        block_size_count = pool_geometric_sizes(16, 1024, 4, block_sizes);
+    }
+    // when the pools can't be set up every request goes to the next
+    // allocator, pool_malloc fails without pools
+    pool_init_growable(block_sizes, block_size_count, reserve);
+
+    in_init = false;
+    __atomic_store_n(&ready, true, __ATOMIC_RELEASE);
+}
+
+/* @brief makes sure the shim is initialized
+ *
+ * returns false while the calling thread is initializing it, in which
+ * case allocations must come from boot_buffer
+*/
+
+static inline bool shim_ready(void)
+{
+    if (__atomic_load_n(&ready, __ATOMIC_ACQUIRE)) {
+        return true;
+    }
+    if (in_init) {
+        return false;
+    }
+    pthread_once(&init_once, shim_init);
+    return true;
+}
+
+/* @brief allocates from boot_buffer while the shim is initialized
+ *
+ * param[in] n: size of the object that is to be allocated
+ *
+ * returns the address of the allocated memory or NULL
+*/
+
+static void *boot_alloc(size_t n)
+{
+    size_t start = boot_used;
+
+    n = (n + 15) & ~(size_t) 15;
+    if (n > BOOT_SIZE - start) {
+        return NULL;
+    }
+    boot_used += n;
+    // static, and so already zero for calloc
+    return &boot_buffer[start];
+}
+
+static inline bool is_boot(const void *ptr)
+{
+    return (uintptr_t) ptr - (uintptr_t) boot_buffer < BOOT_SIZE;
+}
+
+
+/* Interposed Functions */
+
+
+void *malloc(size_t n)
+{
+    if (!shim_ready()) {
+        return boot_alloc(n);
+    }
+
+    void *ptr = pool_malloc(n);
+    return ptr != NULL ? ptr : next_malloc(n);
+}
+
+void free(void *ptr)
+{
+    if (ptr == NULL || is_boot(ptr)) {
+        return;
+    }
+    if (pool_owns(ptr)) {
+        pool_free(ptr);
+    }
+    else if (shim_ready()) {
+        next_free(ptr);
+    }
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    if (!shim_ready()) {
+        size_t n;
+        return __builtin_mul_overflow(nmemb, size, &n) ? NULL :
+            boot_alloc(n);
+    }
+
+    void *ptr = pool_calloc(nmemb, size);
+    return ptr != NULL ? ptr : next_calloc(nmemb, size);
+}
+
+/* @brief resizes an object, keeping objects on the pool heap in place
+ * while n fits their block and moving them with one copy otherwise,
+ * possibly to the next allocator
+*/
+
+void *realloc(void *ptr, size_t n)
+{
+    if (ptr == NULL) {
+        return malloc(n);
+    }
+    if (is_boot(ptr)) {
+        // boot_buffer objects don't record their size, copy what's left
+        void *moved = malloc(n);
+        size_t left = (uintptr_t) boot_buffer + BOOT_SIZE - (uintptr_t) ptr;
+        if (moved != NULL) {
+            memcpy(moved, ptr, n < left ? n : left);
+        }
+        return moved;
+    }
+    if (!pool_owns(ptr) && shim_ready()) {
+        return next_realloc(ptr, n);
+    }
+
+    size_t size = pool_usable_size(ptr);
+    if (n == 0) {
+        pool_free(ptr);
+        return NULL;
+    }
+    if (n <= size) {
+        return ptr;
+    }
+
+    void *moved = malloc(n);
+    if (moved != NULL) {
+        memcpy(moved, ptr, size);
+        pool_free(ptr);
+    }
+    return moved;
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t n)
+{
+    if (alignment < sizeof(void *) || (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+    if (!shim_ready()) {
+        return ENOMEM;
+    }
+
+    void *ptr = pool_memalign(alignment, n);
+    if (ptr == NULL) {
+        return next_posix_memalign(memptr, alignment, n);
+    }
+    *memptr = ptr;
+    return 0;
+}
+
+size_t malloc_usable_size(void *ptr)
+{
+    if (ptr == NULL || is_boot(ptr) || !shim_ready()) {
+        return 0;
+    }
+    if (pool_owns(ptr)) {
+        return pool_usable_size(ptr);
+    }
+    return next_malloc_usable_size(ptr);
+}
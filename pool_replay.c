@@ -0,0 +1,512 @@
+/*
+ * @file pool_replay.c
+ * @brief replays an allocation trace against a configuration of the
+ * tunable pool allocator
+ *
+ *
+ * Reads a trace recorded by pool_alloc.c compiled with POOL_TRACE (see
+ * pool_trace.h), and makes the same calls in the same order on the global
+ * pools, on a single thread so that every run is the same. Prints how
+ * long the calls took, how many allocations failed, and the most bytes
+ * that were live at once, so candidate block sizes can be compared on
+ * recorded traffic.
+ *
+ * Usage: pool_replay [-s sizes] [-w weights] [-g reserve] [-S] [-e] [-v]
+ *                    trace
+ * ~ -s: comma separated block sizes to replay on instead of the ones the
+ *   trace recorded, set up again wherever the trace called pool_init
+ * ~ -w: comma separated weights of the block sizes, as for
+ *   pool_init_weighted
+ * ~ -g: a growable heap of reserve bytes, weights are ignored
+ * ~ -S: pools made of spans, weights are ignored
+ * ~ -e: pools on the fixed heap threaded up front, as by pool_init_eager,
+ *   with the block sizes given or the ones the trace recorded
+ * ~ -v: print the counters of every pool at the end, see pool_dump_stats
+ *
+ * Objects are told apart by the offset the trace recorded for them. An
+ * allocation that failed in the trace is freed right away when it
+ * succeeds in the replay, since the trace doesn't say how long it lived.
+ * The time includes looking the objects up, which is the same for every
+ * configuration.
+ *
+ * @author Akash Arun <akasha@andrew.cmu.edu>
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include "pool_alloc.h"
+#include "pool_trace.h"
+
+
+#define MAX_NUM_POOLS POOL_MAX_NUM_POOLS
+#define MAP_MIN_SIZE 1024
+
+
+/* Data Structures:
+ *
+ * config_t is a configuration of the pools, either given on the command
+ * line or recorded by a POOL_TRACE_INIT record.
+ *
+ * live_t is an object allocated by the replay, found by the offset the
+ * trace recorded for it in map, a hash table with linear probing.
+*/
+
+typedef struct config {
+    size_t block_sizes[MAX_NUM_POOLS];
+    size_t weights[MAX_NUM_POOLS];
+    size_t count;
+    size_t reserve;
+    bool weighted;
+    bool spans;
+    bool eager;
+} config_t;
+
+typedef struct live {
+    uint32_t offset;
+    void *ptr;
+    size_t size;
+} live_t;
+
+typedef struct entry {
+    pool_trace_record_t record;
+    size_t seq;
+} entry_t;
+
+
+/* Global Variables:
+ * map holds the live objects, with map_size slots of which map_used are
+ * taken
+ * live_bytes and block_bytes are the bytes the live objects asked for
+ * and the bytes of their blocks, and peak_* the most of each at once
+*/
+
+static live_t *map;
+static size_t map_size, map_used;
+static size_t live_bytes, block_bytes, peak_bytes, peak_block_bytes;
+
+
+/* Helper Functions: */
+
+
+static inline size_t map_slot(uint32_t offset)
+{
+    return ((uint64_t) offset * 0x9e3779b97f4a7c15ULL >> 32) &
+        (map_size - 1);
+}
+
+/* @brief adds an object to map, doubling it when half full
+ *
+ * returns false if there is no memory for a larger map
+*/
+
+static bool map_put(uint32_t offset, void *ptr, size_t size)
+{
+    if (2 * (map_used + 1) > map_size) {
+        live_t *old = map;
+        size_t old_size = map_size;
+        size_t new_size = map_size == 0 ? MAP_MIN_SIZE : 2 * map_size;
+
+        map = calloc(new_size, sizeof(live_t));
+        if (map == NULL) {
+            map = old;
+            return false;
+        }
+        map_size = new_size;
+        map_used = 0;
+        for (size_t k = 0; k < old_size; k++) {
+            if (old[k].ptr != NULL) {
+                map_put(old[k].offset, old[k].ptr, old[k].size);
+            }
+        }
+        free(old);
+    }
+
+    size_t k = map_slot(offset);
+    while (map[k].ptr != NULL) {
+        k = (k + 1) & (map_size - 1);
+    }
+    map[k] = (live_t) {offset, ptr, size};
+    map_used++;
+    return true;
+}
+
+/* @brief removes the object at offset from map
+ *
+ * param[out] found: the object
+ *
+ * returns false if no object is at offset
+*/
+
+static bool map_take(uint32_t offset, live_t *found)
+{
+    if (map_size == 0) {
+        return false;
+    }
+
+    size_t k = map_slot(offset);
+    while (map[k].ptr != NULL && map[k].offset != offset) {
+        k = (k + 1) & (map_size - 1);
+    }
+    if (map[k].ptr == NULL) {
+        return false;
+    }
+    *found = map[k];
+    map[k].ptr = NULL;
+    map_used--;
+
+    // moves the objects after the hole back, so probes still find them
+    for (size_t next = (k + 1) & (map_size - 1); map[next].ptr != NULL;
+         next = (next + 1) & (map_size - 1)) {
+        size_t home = map_slot(map[next].offset);
+        if (((next - home) & (map_size - 1)) >=
+            ((next - k) & (map_size - 1))) {
+            map[k] = map[next];
+            map[next].ptr = NULL;
+            k = next;
+        }
+    }
+    return true;
+}
+
+static void map_clear(void)
+{
+    if (map != NULL) {
+        memset(map, 0, map_size * sizeof(live_t));
+    }
+    map_used = 0;
+    live_bytes = block_bytes = 0;
+}
+
+// counts an object in or out of the live bytes
+static void track(void *ptr, size_t size, bool live)
+{
+    if (live) {
+        live_bytes += size;
+        block_bytes += pool_usable_size(ptr);
+        if (live_bytes > peak_bytes) {
+            peak_bytes = live_bytes;
+        }
+        if (block_bytes > peak_block_bytes) {
+            peak_block_bytes = block_bytes;
+        }
+    }
+    else {
+        live_bytes -= size;
+        block_bytes -= pool_usable_size(ptr);
+    }
+}
+
+/* @brief reads a comma separated list of numbers
+ *
+ * param[out] values: the numbers, room for MAX_NUM_POOLS
+ *
+ * returns how many numbers were read, 0 if the list is invalid
+*/
+
+static size_t parse_list(const char *list, size_t *values)
+{
+    size_t count = 0;
+
+    while (*list != '\0') {
+        char *end;
+        unsigned long long value = strtoull(list, &end, 10);
+
+        if (end == list || value == 0 || count == MAX_NUM_POOLS ||
+            (*end != ',' && *end != '\0')) {
+            return 0;
+        }
+        values[count++] = value;
+        list = *end == ',' ? end + 1 : end;
+    }
+    return count;
+}
+
+static bool apply_config(const config_t *config)
+{
+    if (config->spans) {
+        return pool_init_spans(config->block_sizes, config->count);
+    }
+    if (config->reserve != 0) {
+        return pool_init_growable(config->block_sizes, config->count,
+                                  config->reserve);
+    }
+    if (config->eager) {
+        return pool_init_eager(config->block_sizes,
+                               config->weighted ? config->weights : NULL,
+                               config->count);
+    }
+    return pool_init_weighted(config->block_sizes,
+                              config->weighted ? config->weights : NULL,
+                              config->count);
+}
+
+static void print_config(const config_t *config)
+{
+    printf("block sizes: ");
+    for (size_t i = 0; i < config->count; i++) {
+        printf("%s%zu", i == 0 ? "" : ",", config->block_sizes[i]);
+    }
+    if (config->spans) {
+        printf(" in spans");
+    }
+    else if (config->reserve != 0) {
+        printf(" on a %zu byte growable heap", config->reserve);
+    }
+    else if (config->eager) {
+        printf(" threaded eagerly");
+    }
+    printf("\n");
+}
+
+// orders records by time, and records of the same time as in the file
+static int compare_entries(const void *a, const void *b)
+{
+    const entry_t *x = a, *y = b;
+
+    if (x->record.time != y->record.time) {
+        return x->record.time < y->record.time ? -1 : 1;
+    }
+    return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+/* @brief reads the records of a trace file, sorted by time
+ *
+ * param[out] count: the number of records
+ *
+ * returns the records, or NULL if the file can't be read or isn't a trace
+*/
+
+static entry_t *read_trace(const char *path, size_t *count)
+{
+    FILE *in = fopen(path, "rb");
+    pool_trace_header_t header;
+    pool_trace_record_t record;
+    entry_t *entries = NULL;
+    size_t capacity = 0;
+
+    *count = 0;
+    if (in == NULL) {
+        perror(path);
+        return NULL;
+    }
+    if (fread(&header, sizeof(header), 1, in) != 1 ||
+        memcmp(header.magic, POOL_TRACE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.record_size != sizeof(pool_trace_record_t)) {
+        fprintf(stderr, "%s: not a pool allocator trace\n", path);
+        fclose(in);
+        return NULL;
+    }
+
+    while (fread(&record, sizeof(record), 1, in) == 1) {
+        if (*count == capacity) {
+            capacity = capacity == 0 ? 4096 : 2 * capacity;
+            entry_t *grown = realloc(entries, capacity * sizeof(entry_t));
+            if (grown == NULL) {
+                free(entries);
+                fclose(in);
+                return NULL;
+            }
+            entries = grown;
+        }
+        entries[*count] = (entry_t) {record, *count};
+        (*count)++;
+    }
+    fclose(in);
+
+    qsort(entries, *count, sizeof(entry_t), compare_entries);
+    return entries;
+}
+
+static double seconds(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) (now.tv_sec - start->tv_sec) +
+        (double) (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+
+int main(int argc, char **argv)
+{
+    static uint32_t realloc_from[UINT16_MAX + 1];
+    config_t given = {0}, recorded = {0};
+    size_t count, init_left = 0, threads = 0;
+    size_t mallocs = 0, frees = 0, reallocs = 0;
+    size_t failures = 0, recorded_failures = 0;
+    bool verbose = false, configured = false;
+    struct timespec start;
+    entry_t *entries;
+    live_t found;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:w:g:Sev")) != -1) {
+        if (opt == 's') {
+            given.count = parse_list(optarg, given.block_sizes);
+        }
+        else if (opt == 'w') {
+            given.weighted = parse_list(optarg, given.weights) != 0;
+        }
+        else if (opt == 'g') {
+            given.reserve = strtoull(optarg, NULL, 10);
+        }
+        else if (opt == 'S') {
+            given.spans = true;
+        }
+        else if (opt == 'e') {
+            given.eager = true;
+        }
+        else if (opt == 'v') {
+            verbose = true;
+        }
+        else {
+            optind = argc;
+            break;
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "usage: %s [-s sizes] [-w weights] [-g reserve] "
+                "[-S] [-e] [-v] trace\n", argv[0]);
+        return 1;
+    }
+
+    entries = read_trace(argv[optind], &count);
+    if (entries == NULL) {
+        return 1;
+    }
+    if (given.count != 0) {
+        if (!apply_config(&given)) {
+            fprintf(stderr, "%s: invalid configuration\n", argv[0]);
+            return 1;
+        }
+        configured = true;
+        print_config(&given);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t k = 0; k < count; k++) {
+        pool_trace_record_t *record = &entries[k].record;
+        void *ptr;
+
+        if (record->thread > threads) {
+            threads = record->thread;
+        }
+        if (!configured && record->op >= POOL_TRACE_MALLOC) {
+            fprintf(stderr, "%s: the trace starts without pool_init, "
+                    "pass block sizes with -s\n", argv[0]);
+            return 1;
+        }
+
+        switch (record->op) {
+        case POOL_TRACE_INIT:
+            // objects of the earlier pools are gone
+            map_clear();
+            recorded.count = 0;
+            recorded.weighted = !(record->flags & POOL_TRACE_SPANS);
+            recorded.spans = record->flags & POOL_TRACE_SPANS;
+            recorded.eager = (record->flags & POOL_TRACE_EAGER) ||
+                given.eager;
+            recorded.reserve = record->flags & POOL_TRACE_GROWABLE ?
+                record->size : 0;
+            init_left = record->offset;
+            if (given.count != 0) {
+                apply_config(&given);
+            }
+            break;
+
+        case POOL_TRACE_INIT_SIZE:
+            if (init_left == 0 || recorded.count == MAX_NUM_POOLS) {
+                break;
+            }
+            recorded.block_sizes[recorded.count] = record->size;
+            recorded.weights[recorded.count++] = record->offset;
+            if (--init_left == 0 && given.count == 0) {
+                configured = apply_config(&recorded);
+                print_config(&recorded);
+            }
+            break;
+
+        case POOL_TRACE_MALLOC:
+            mallocs++;
+            ptr = pool_malloc(record->size);
+            if (ptr == NULL) {
+                failures++;
+            }
+            if (record->offset == POOL_TRACE_NULL) {
+                recorded_failures++;
+                pool_free(ptr);
+            }
+            else if (ptr != NULL) {
+                // a free the trace missed, while tracing was set up
+                if (map_take(record->offset, &found)) {
+                    track(found.ptr, found.size, false);
+                    pool_free(found.ptr);
+                }
+                map_put(record->offset, ptr, record->size);
+                track(ptr, record->size, true);
+            }
+            break;
+
+        case POOL_TRACE_FREE:
+            frees++;
+            if (map_take(record->offset, &found)) {
+                track(found.ptr, found.size, false);
+                pool_free(found.ptr);
+            }
+            break;
+
+        case POOL_TRACE_REALLOC_FROM:
+            realloc_from[record->thread] = record->offset;
+            break;
+
+        case POOL_TRACE_REALLOC:
+            reallocs++;
+            if (!map_take(realloc_from[record->thread], &found)) {
+                found = (live_t) {0, NULL, 0};
+            }
+            else {
+                track(found.ptr, found.size, false);
+            }
+            ptr = pool_realloc(found.ptr, record->size);
+            if (ptr == NULL) {
+                failures++;
+                ptr = found.ptr;
+            }
+            else {
+                found.size = record->size;
+            }
+            if (ptr != NULL) {
+                map_put(record->offset, ptr, found.size);
+                track(ptr, found.size, true);
+            }
+            break;
+
+        default:
+            break;
+        }
+    }
+    double elapsed = seconds(&start);
+    size_t ops = mallocs + frees + reallocs;
+
+    printf("records: %zu from %zu threads\n", count, threads);
+    printf("calls: %zu mallocs, %zu frees, %zu reallocs in %.6f s, "
+           "%.2f million per second\n", mallocs, frees, reallocs, elapsed,
+           elapsed > 0 ? ops / elapsed / 1e6 : 0.0);
+    printf("failed allocations: %zu (%zu in the trace)\n", failures,
+           recorded_failures);
+    printf("peak: %zu bytes requested, %zu bytes of blocks\n", peak_bytes,
+           peak_block_bytes);
+    if (verbose) {
+        pool_dump_stats(stdout);
+    }
+
+    free(entries);
+    free(map);
+    return 0;
+}
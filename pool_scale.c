@@ -0,0 +1,578 @@
+/*
+ * @file pool_scale.c
+ * @brief multithreaded scalability benchmarks for the tunable pool
+ * allocator
+ *
+ *
+ * Runs the classic multithreaded allocator workloads on 1 to N threads
+ * against glibc malloc and the modes of the pool allocator, and prints
+ * the throughput and the peak RSS of every run as CSV, one line per
+ * allocator, workload and number of threads.
+ *
+ * The workloads are:
+ * ~ larson: every thread frees a random object of its own set and
+ *   replaces it with one of a random size from 16 to 1024 bytes. The
+ *   threads are replaced by new ones that take their sets over every
+ *   tenth of the run, so blocks are freed by threads that didn't
+ *   allocate them and thread caches come and go.
+ * ~ threadtest: every thread allocates 1000 objects of 64 bytes and
+ *   frees them, over and over.
+ * ~ prodcons: every thread allocates objects from 16 to 256 bytes and
+ *   passes them on to the next thread through a ring, which frees them,
+ *   so every free is of a block allocated on another thread.
+ * ~ shbench: every thread allocates batches of 512 objects, mostly from
+ *   16 to 128 bytes with one in eight up to 1024 bytes, and frees the odd
+ *   ones in order and the even ones in reverse.
+ *
+ * The allocators are:
+ * ~ glibc: malloc and free
+ * ~ pool-locked: one pool_create_growable allocator behind a mutex, the
+ *   allocator as a single threaded program would share it
+ * ~ pool-ctx: the same allocator used by all threads without a lock
+ * ~ pool: pool_malloc and pool_free on growable global pools, with the
+ *   per-thread caches
+ *
+ * Every run is in a process of its own, so runs don't share heaps and
+ * the RSS is the peak of that run alone. Throughput counts the mallocs
+ * and frees of all threads, timed from when the first thread starts
+ * until the last one finishes.
+ *
+ * Usage: pool_scale [-t threads] [-n allocations] [-w workload]
+ *                   [-a allocator]
+ * ~ -t: the most threads to run, the number of CPUs by default
+ * ~ -n: allocations per thread per run, 200000 by default
+ * ~ -w: run only this workload
+ * ~ -a: run only this allocator
+ *
+ * @author Akash Arun <akasha@andrew.cmu.edu>
+*/
+
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "pool_alloc.h"
+
+
+#define DEFAULT_ALLOCATIONS 200000
+#define LARSON_SLOTS 1024
+#define LARSON_EPOCHS 10
+#define THREADTEST_BATCH 1000
+#define SHBENCH_BATCH 512
+#define RING_SIZE 1024
+#define GROWABLE_RESERVE ((size_t) 1 << 30)
+
+
+/* Data Structures:
+ *
+ * allocator_t is an allocator under test, set up in the process of a
+ * run before its threads start.
+ *
+ * ring_t passes objects from one thread to another, written only by
+ * the producer at tail and read only by the consumer at head.
+ *
+ * worker_t is the state of one thread of a workload, with the number of
+ * mallocs and frees it made and when it started and finished them. Its
+ * slots outlive the thread for larson, whose next thread takes them
+ * over.
+ *
+ * result_t is what the process of a run sends back.
+ *
+ * workload_t is a benchmark, with the function its threads run.
+*/
+
+typedef struct allocator {
+    const char *name;
+    void (*setup)(void);
+    void *(*malloc)(size_t n);
+    void (*free)(void *ptr);
+} allocator_t;
+
+typedef struct ring {
+    _Alignas(64) _Atomic size_t head;
+    _Alignas(64) _Atomic size_t tail;
+    void *items[RING_SIZE];
+} ring_t;
+
+typedef struct worker {
+    pthread_t thread;
+    size_t allocations;
+    uint64_t ops;
+    double began;
+    double ended;
+    uint64_t rng;
+    ring_t *in;
+    ring_t *out;
+    void *slots[LARSON_SLOTS];
+} worker_t;
+
+typedef struct result {
+    double seconds;
+    uint64_t ops;
+} result_t;
+
+typedef struct workload {
+    const char *name;
+    void *(*run)(void *arg);
+} workload_t;
+
+
+/* Global Variables:
+ * allocator is the allocator of the current run
+ * ctx and ctx_lock are the allocator instance of pool-locked and pool-ctx
+ * start holds the threads of a run until they are all created
+*/
+
+static const allocator_t *allocator;
+static pool_ctx_t *ctx;
+static pthread_mutex_t ctx_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_barrier_t start;
+
+
+/* Helper Functions: */
+
+
+static inline uint64_t next_random(uint64_t *rng)
+{
+    *rng ^= *rng << 13;
+    *rng ^= *rng >> 7;
+    *rng ^= *rng << 17;
+    return *rng;
+}
+
+static double now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// waits for the other threads of the run, then notes when it started
+static void worker_begin(worker_t *worker)
+{
+    pthread_barrier_wait(&start);
+    worker->began = now();
+}
+
+static void geometric_sizes(size_t *block_sizes, size_t *count)
+{
+    *count = pool_geometric_sizes(16, 1024, 4, block_sizes);
+}
+
+
+/* Allocators: */
+
+
+static void glibc_setup(void)
+{
+}
+
+static void pool_setup(void)
+{
+    size_t block_sizes[POOL_MAX_NUM_POOLS], count;
+
+    geometric_sizes(block_sizes, &count);
+    if (!pool_init_growable(block_sizes, count, GROWABLE_RESERVE)) {
+        fprintf(stderr, "pool_scale: pool_init_growable failed\n");
+        exit(1);
+    }
+}
+
+static void ctx_setup(void)
+{
+    size_t block_sizes[POOL_MAX_NUM_POOLS], count;
+
+    geometric_sizes(block_sizes, &count);
+    ctx = pool_create_growable(block_sizes, count, GROWABLE_RESERVE);
+    if (ctx == NULL) {
+        fprintf(stderr, "pool_scale: pool_create_growable failed\n");
+        exit(1);
+    }
+}
+
+static void *locked_malloc(size_t n)
+{
+    pthread_mutex_lock(&ctx_lock);
+    void *ptr = pool_ctx_malloc(ctx, n);
+    pthread_mutex_unlock(&ctx_lock);
+    return ptr;
+}
+
+static void locked_free(void *ptr)
+{
+    pthread_mutex_lock(&ctx_lock);
+    pool_ctx_free(ctx, ptr);
+    pthread_mutex_unlock(&ctx_lock);
+}
+
+static void *ctx_malloc(size_t n)
+{
+    return pool_ctx_malloc(ctx, n);
+}
+
+static void ctx_free(void *ptr)
+{
+    pool_ctx_free(ctx, ptr);
+}
+
+static const allocator_t allocators[] = {
+    {"glibc", glibc_setup, malloc, free},
+    {"pool-locked", ctx_setup, locked_malloc, locked_free},
+    {"pool-ctx", ctx_setup, ctx_malloc, ctx_free},
+    {"pool", pool_setup, pool_malloc, pool_free}
+};
+
+// stops the run if an allocation fails, so its numbers aren't reported
+static inline void *checked_malloc(size_t n)
+{
+    void *ptr = allocator->malloc(n);
+
+    if (ptr == NULL) {
+        fprintf(stderr, "pool_scale: %s ran out of memory\n",
+                allocator->name);
+        _exit(1);
+    }
+    return ptr;
+}
+
+
+/* Workloads: */
+
+
+static void *run_larson(void *arg)
+{
+    worker_t *worker = arg;
+    size_t steps = worker->allocations / LARSON_EPOCHS;
+
+    worker_begin(worker);
+    for (size_t step = 0; step < steps; step++) {
+        size_t k = next_random(&worker->rng) % LARSON_SLOTS;
+        size_t size = 16 + next_random(&worker->rng) % 1009;
+
+        allocator->free(worker->slots[k]);
+        worker->slots[k] = checked_malloc(size);
+    }
+    worker->ops += 2 * steps;
+    worker->ended = now();
+    return NULL;
+}
+
+static void *run_threadtest(void *arg)
+{
+    worker_t *worker = arg;
+    void *objects[THREADTEST_BATCH];
+
+    worker_begin(worker);
+    for (size_t done = 0; done < worker->allocations;
+         done += THREADTEST_BATCH) {
+
+        for (size_t k = 0; k < THREADTEST_BATCH; k++) {
+            objects[k] = checked_malloc(64);
+        }
+        for (size_t k = 0; k < THREADTEST_BATCH; k++) {
+            allocator->free(objects[k]);
+        }
+        worker->ops += 2 * THREADTEST_BATCH;
+    }
+    worker->ended = now();
+    return NULL;
+}
+
+/* @brief allocates objects into the ring to the next thread and frees
+ * the ones in the ring from the previous thread, until it has done both
+ * for all of its allocations
+*/
+
+static void *run_prodcons(void *arg)
+{
+    worker_t *worker = arg;
+    size_t produced = 0, consumed = 0;
+
+    worker_begin(worker);
+    while (produced < worker->allocations || consumed < worker->allocations) {
+        size_t tail = atomic_load_explicit(&worker->out->tail,
+                                           memory_order_relaxed);
+        size_t head = atomic_load_explicit(&worker->out->head,
+                                           memory_order_acquire);
+        bool progress = false;
+
+        for (; produced < worker->allocations && tail - head < RING_SIZE;
+             produced++, tail++) {
+            size_t size = 16 + next_random(&worker->rng) % 241;
+            worker->out->items[tail % RING_SIZE] = checked_malloc(size);
+            progress = true;
+        }
+        atomic_store_explicit(&worker->out->tail, tail, memory_order_release);
+
+        head = atomic_load_explicit(&worker->in->head, memory_order_relaxed);
+        tail = atomic_load_explicit(&worker->in->tail, memory_order_acquire);
+        for (; head != tail; head++, consumed++) {
+            allocator->free(worker->in->items[head % RING_SIZE]);
+            progress = true;
+        }
+        atomic_store_explicit(&worker->in->head, head, memory_order_release);
+        worker->ops = produced + consumed;
+
+        if (!progress) {
+            sched_yield();
+        }
+    }
+    worker->ended = now();
+    return NULL;
+}
+
+static void *run_shbench(void *arg)
+{
+    worker_t *worker = arg;
+    void *objects[SHBENCH_BATCH];
+
+    worker_begin(worker);
+    for (size_t done = 0; done < worker->allocations;
+         done += SHBENCH_BATCH) {
+
+        for (size_t k = 0; k < SHBENCH_BATCH; k++) {
+            uint64_t random = next_random(&worker->rng);
+            size_t size = random % 8 != 0 ? 16 + (random >> 3) % 113 :
+                16 + (random >> 3) % 1009;
+            objects[k] = checked_malloc(size);
+        }
+        for (size_t k = 1; k < SHBENCH_BATCH; k += 2) {
+            allocator->free(objects[k]);
+        }
+        for (size_t k = SHBENCH_BATCH; k > 0; k -= 2) {
+            allocator->free(objects[k-2]);
+        }
+        worker->ops += 2 * SHBENCH_BATCH;
+    }
+    worker->ended = now();
+    return NULL;
+}
+
+static const workload_t workloads[] = {
+    {"larson", run_larson},
+    {"threadtest", run_threadtest},
+    {"prodcons", run_prodcons},
+    {"shbench", run_shbench}
+};
+
+
+/* @brief starts a thread for every worker, releases them together and
+ * waits for them to finish
+ *
+ * The threads time themselves, since they can be done before the main
+ * thread gets to run again after releasing them.
+ *
+ * returns the seconds from when the first one started until the last
+ * one finished
+*/
+
+static double run_threads(const workload_t *workload, worker_t *workers,
+                          size_t threads)
+{
+    double began, ended;
+
+    pthread_barrier_init(&start, NULL, threads + 1);
+    for (size_t t = 0; t < threads; t++) {
+        if (pthread_create(&workers[t].thread, NULL, workload->run,
+                           &workers[t]) != 0) {
+            fprintf(stderr, "pool_scale: pthread_create failed\n");
+            _exit(1);
+        }
+    }
+    pthread_barrier_wait(&start);
+    for (size_t t = 0; t < threads; t++) {
+        pthread_join(workers[t].thread, NULL);
+    }
+    pthread_barrier_destroy(&start);
+
+    began = workers[0].began;
+    ended = workers[0].ended;
+    for (size_t t = 1; t < threads; t++) {
+        if (workers[t].began < began) {
+            began = workers[t].began;
+        }
+        if (workers[t].ended > ended) {
+            ended = workers[t].ended;
+        }
+    }
+    return ended - began;
+}
+
+/* @brief runs a workload on a number of threads, in the process of the
+ * run
+ *
+ * returns the seconds it took and the mallocs and frees it timed
+*/
+
+static result_t run_workload(const workload_t *workload, size_t threads,
+                             size_t allocations)
+{
+    worker_t *workers = calloc(threads, sizeof(worker_t));
+    ring_t *rings = aligned_alloc(64, threads * sizeof(ring_t));
+    bool larson = workload->run == run_larson;
+    result_t result = {0, 0};
+
+    if (workers == NULL || rings == NULL) {
+        fprintf(stderr, "pool_scale: out of memory\n");
+        _exit(1);
+    }
+    memset(rings, 0, threads * sizeof(ring_t));
+    for (size_t t = 0; t < threads; t++) {
+        workers[t].allocations = allocations;
+        workers[t].rng = 0x2545f4914f6cdd1dULL * (t + 1);
+        workers[t].out = &rings[t];
+        workers[t].in = &rings[(t + threads - 1) % threads];
+    }
+
+    if (!larson) {
+        result.seconds = run_threads(workload, workers, threads);
+    }
+    else {
+        // the sets are filled here, so even the first threads free
+        // blocks they didn't allocate
+        for (size_t t = 0; t < threads; t++) {
+            for (size_t k = 0; k < LARSON_SLOTS; k++) {
+                size_t size = 16 + next_random(&workers[t].rng) % 1009;
+                workers[t].slots[k] = checked_malloc(size);
+            }
+        }
+        for (size_t epoch = 0; epoch < LARSON_EPOCHS; epoch++) {
+            result.seconds += run_threads(workload, workers, threads);
+        }
+        for (size_t t = 0; t < threads; t++) {
+            for (size_t k = 0; k < LARSON_SLOTS; k++) {
+                allocator->free(workers[t].slots[k]);
+            }
+        }
+    }
+
+    for (size_t t = 0; t < threads; t++) {
+        result.ops += workers[t].ops;
+    }
+    free(rings);
+    free(workers);
+    return result;
+}
+
+/* @brief runs a workload in a child process and prints its line of the
+ * CSV
+ *
+ * returns true on success, false if the run failed
+*/
+
+static bool run(const allocator_t *alloc, const workload_t *workload,
+                size_t threads, size_t allocations)
+{
+    struct rusage usage;
+    result_t result;
+    int fds[2], status;
+    pid_t pid;
+
+    if (pipe(fds) != 0) {
+        perror("pipe");
+        return false;
+    }
+    fflush(stdout);
+
+    pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return false;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        allocator = alloc;
+        allocator->setup();
+        result = run_workload(workload, threads, allocations);
+        if (write(fds[1], &result, sizeof(result)) != sizeof(result)) {
+            _exit(1);
+        }
+        _exit(0);
+    }
+
+    close(fds[1]);
+    ssize_t got = read(fds[0], &result, sizeof(result));
+    close(fds[0]);
+    if (wait4(pid, &status, 0, &usage) != pid || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0 || got != sizeof(result)) {
+        fprintf(stderr, "pool_scale: %s %s on %zu threads failed\n",
+                alloc->name, workload->name, threads);
+        return false;
+    }
+
+    printf("%s,%s,%zu,%llu,%.6f,%.0f,%ld\n", alloc->name, workload->name,
+           threads, (unsigned long long) result.ops, result.seconds,
+           result.seconds > 0 ? result.ops / result.seconds : 0.0,
+           usage.ru_maxrss);
+    return true;
+}
+
+
+int main(int argc, char **argv)
+{
+    size_t num_allocators = sizeof(allocators)/sizeof(allocators[0]);
+    size_t num_workloads = sizeof(workloads)/sizeof(workloads[0]);
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t max_threads = cpus > 0 ? (size_t) cpus : 1;
+    size_t allocations = DEFAULT_ALLOCATIONS;
+    const char *only_workload = NULL, *only_allocator = NULL;
+    bool ok = true;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:n:w:a:")) != -1) {
+        if (opt == 't') {
+            max_threads = strtoull(optarg, NULL, 10);
+        }
+        else if (opt == 'n') {
+            allocations = strtoull(optarg, NULL, 10);
+        }
+        else if (opt == 'w') {
+            only_workload = optarg;
+        }
+        else if (opt == 'a') {
+            only_allocator = optarg;
+        }
+        else {
+            fprintf(stderr, "usage: %s [-t threads] [-n allocations] "
+                    "[-w workload] [-a allocator]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (max_threads < 1 || allocations < 1) {
+        fprintf(stderr, "pool_scale: threads and allocations must be at "
+                "least 1\n");
+        return 1;
+    }
+
+    printf("allocator,workload,threads,ops,seconds,ops_per_sec,max_rss_kb\n");
+    for (size_t w = 0; w < num_workloads; w++) {
+        if (only_workload != NULL &&
+            strcmp(only_workload, workloads[w].name) != 0) {
+            continue;
+        }
+
+        for (size_t a = 0; a < num_allocators; a++) {
+            if (only_allocator != NULL &&
+                strcmp(only_allocator, allocators[a].name) != 0) {
+                continue;
+            }
+
+            for (size_t threads = 1; threads <= max_threads; threads++) {
+                ok = run(&allocators[a], &workloads[w], threads,
+                         allocations) && ok;
+            }
+        }
+    }
+    return ok ? 0 : 1;
+}
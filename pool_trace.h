@@ -0,0 +1,72 @@
+/*
+ * @file pool_trace.h
+ * @brief format of the allocation traces of the tunable pool allocator
+ *
+ *
+ * When pool_alloc.c is compiled with -DPOOL_TRACE, every call of
+ * pool_init and its variants, pool_malloc, pool_memalign, pool_calloc,
+ * pool_realloc, pool_free, pool_free_sized and the batch functions on
+ * the global pools is recorded to the file named by POOL_TRACE_FILE
+ * (pool_trace.bin by default). Allocator instances are not traced.
+ *
+ * The file is a pool_trace_header_t followed by pool_trace_record_t
+ * records. Each thread writes its records in order, but the records of
+ * different threads are interleaved in chunks, so readers sort them by
+ * time. Allocations are timed once they return and frees when they are
+ * called, so a block freed by one thread and reused by another is freed
+ * before it is allocated again.
+ *
+ * @author Akash Arun <akasha@andrew.cmu.edu>
+*/
+
+#ifndef POOL_TRACE_H
+#define POOL_TRACE_H
+
+#include <stdint.h>
+
+#define POOL_TRACE_MAGIC "POOLTRC1"
+
+// The offset of a NULL pointer, or of one outside the heap.
+#define POOL_TRACE_NULL UINT32_MAX
+
+// pool_init: size is the size of the heap, offset the number of block
+// sizes and flags says how the heap is split. It is followed by one
+// POOL_TRACE_INIT_SIZE record per pool, with the block size in size and
+// the weight in offset.
+#define POOL_TRACE_INIT 0
+#define POOL_TRACE_INIT_SIZE 1
+
+// An allocation of size bytes at offset, and a free of the block at
+// offset, with size the size passed to pool_free_sized or 0.
+#define POOL_TRACE_MALLOC 2
+#define POOL_TRACE_FREE 3
+
+// pool_realloc of the object at offset, followed by a POOL_TRACE_REALLOC
+// record with the new size and the offset it ended up at.
+#define POOL_TRACE_REALLOC_FROM 4
+#define POOL_TRACE_REALLOC 5
+
+// The flags of a POOL_TRACE_INIT record.
+#define POOL_TRACE_GROWABLE 1
+#define POOL_TRACE_SPANS 2
+#define POOL_TRACE_EAGER 4
+
+typedef struct pool_trace_header {
+    char magic[8];
+    uint32_t record_size;
+    uint32_t reserved;
+} pool_trace_header_t;
+
+typedef struct pool_trace_record {
+    // nanoseconds since the trace started
+    uint64_t time;
+    uint64_t size;
+    // offset of the block into the heap
+    uint32_t offset;
+    // the threads are numbered from 1 in the order they first call in
+    uint16_t thread;
+    uint8_t op;
+    uint8_t flags;
+} pool_trace_record_t;
+
+#endif
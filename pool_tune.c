@@ -0,0 +1,144 @@
+/*
+ * @file pool_tune.c
+ * @brief picks the block sizes of the tunable pool allocator from the
+ * sizes a program requests
+ *
+ *
+ * Reads requested sizes and prints the block sizes and weights that
+ * pool_tune finds for them, ready to be passed to pool_init_weighted or
+ * set as POOL_SIZES for the malloc shim.
+ *
+ * Usage: pool_tune [-n max_classes] [-H heap_size] [file]
+ *
+ * The sizes are read from file, or from standard input, one per line:
+ * ~ "size count": count requests of size bytes
+ * ~ "size": a single request, e.g. one sampled from a running program
+ * ~ "<= size bytes: count": a line of the histogram printed by
+ *   pool_dump_stats, so its output can be fed in as is
+ * Any other line is skipped.
+ *
+ * max_classes defaults to 16 and heap_size to the 64 KB of the global
+ * heap.
+ *
+ * @author Akash Arun <akasha@andrew.cmu.edu>
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "pool_alloc.h"
+
+
+#define DEFAULT_CLASSES 16
+#define DEFAULT_HEAP_SIZE 65536
+#define LINE_SIZE 256
+
+
+/* Helper Functions: */
+
+
+/* @brief adds the requests on one line of input to the histogram
+ *
+ * param[in] line: the line
+ * param[out] histogram: the histogram of requested sizes
+*/
+
+static void read_line(const char *line, uint64_t *histogram)
+{
+    unsigned long long size, count = 1;
+    char extra;
+
+    while (*line == ' ' || *line == '\t') {
+        line++;
+    }
+    if (sscanf(line, "<= %llu bytes: %llu", &size, &count) == 2 ||
+        sscanf(line, "%llu %llu %c", &size, &count, &extra) == 2 ||
+        sscanf(line, "%llu %c", &size, &extra) == 1) {
+        histogram[pool_hist_bucket(size)] += count;
+    }
+}
+
+/* @brief prints the block sizes and weights as a comma separated list,
+ * and as C arrays
+ *
+ * param[in] block_sizes: the block sizes
+ * param[in] weights: the weights
+ * param[in] count: the number of block sizes
+*/
+
+static void print_config(const size_t *block_sizes, const size_t *weights,
+                         size_t count)
+{
+    printf("POOL_SIZES=");
+    for (size_t i = 0; i < count; i++) {
+        printf("%s%zu", i == 0 ? "" : ",", block_sizes[i]);
+    }
+
+    printf("\n\nsize_t block_sizes[%zu] = {", count);
+    for (size_t i = 0; i < count; i++) {
+        printf("%s%zu", i == 0 ? "" : ", ", block_sizes[i]);
+    }
+    printf("};\nsize_t weights[%zu] = {", count);
+    for (size_t i = 0; i < count; i++) {
+        printf("%s%zu", i == 0 ? "" : ", ", weights[i]);
+    }
+    printf("};\n");
+}
+
+
+int main(int argc, char **argv)
+{
+    static uint64_t histogram[POOL_HIST_BUCKETS];
+    size_t block_sizes[POOL_MAX_NUM_POOLS], weights[POOL_MAX_NUM_POOLS];
+    size_t max_classes = DEFAULT_CLASSES, heap_size = DEFAULT_HEAP_SIZE;
+    size_t count;
+    char line[LINE_SIZE];
+    FILE *in = stdin;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:H:")) != -1) {
+        if (opt == 'n') {
+            max_classes = strtoull(optarg, NULL, 10);
+        }
+        else if (opt == 'H') {
+            heap_size = strtoull(optarg, NULL, 10);
+        }
+        else {
+            fprintf(stderr, "usage: %s [-n max_classes] [-H heap_size] "
+                    "[file]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (max_classes == 0 || max_classes > POOL_MAX_NUM_POOLS) {
+        fprintf(stderr, "%s: max_classes must be from 1 to %d\n", argv[0],
+                POOL_MAX_NUM_POOLS);
+        return 1;
+    }
+    if (optind < argc) {
+        in = fopen(argv[optind], "r");
+        if (in == NULL) {
+            perror(argv[optind]);
+            return 1;
+        }
+    }
+
+    while (fgets(line, sizeof(line), in) != NULL) {
+        read_line(line, histogram);
+    }
+    if (in != stdin) {
+        fclose(in);
+    }
+
+    count = pool_tune(histogram, max_classes, heap_size, block_sizes,
+                      weights);
+    if (count == 0) {
+        fprintf(stderr, "%s: no requested size fits a %zu byte heap\n",
+                argv[0], heap_size);
+        return 1;
+    }
+    print_config(block_sizes, weights, count);
+    return 0;
+}